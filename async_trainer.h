@@ -0,0 +1,335 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <exception>
+#include <chrono>
+
+#include "cm_ctors.h"
+#include "matrix2d.h"
+#include "ring_buffer.h"
+#include "runners.h"
+
+///pipelined training of SimpleLayeredNN by batches of Batch samples, 3 stages on 3 threads:
+/// - stage thread: source fills the next batch into free staging slot, then normalize(inputs) is applied
+/// - calling thread: trains on staged batch, copies outputs of the network and targets into free metrics slot
+/// - metrics thread: loss and accuracy of trained batches
+///Slots are preallocated once and reused (2 per stage by default: double buffering), so while batch k trains,
+///batch k + 1 is staged and metrics of batch k - 1 are computed. Stages are connected by bounded spsc rings,
+///stage which is ahead waits for free slot of the next one (back-pressure), so memory use is fixed.
+///Source which prepares batches on own threads already (mnist_aug::batch_stream) goes to run_stream(): trainer
+///takes its batches in place, without stage thread and copy into stage slot.
+template <class Net, size_t Batch>
+class async_trainer
+{
+public:
+    using Float     = typename Net::Float;
+    using inputs_t  = Matrix2D<Float, Net::inputs_count, Batch>;
+    using targets_t = Matrix2D<Float, Net::outputs_count, Batch>;
+
+    struct report
+    {
+        size_t batches{0};
+        size_t samples{0};
+        ///mean of squared output errors
+        double loss{0};
+        ///share of samples where the biggest output is the biggest target
+        double accuracy{0};
+        ///times trainer waited for the next batch after the first one, 0 means loading and preprocessing were hidden
+        ///behind training
+        size_t trainer_stalls{0};
+        ///from start of run until the first batch was ready, pipeline fill is not a stall
+        double first_batch_seconds{0};
+        ///times stage thread waited for free slot (trainer is slower than source, expected)
+        size_t stage_stalls{0};
+        ///times trainer waited for metrics thread
+        size_t metrics_stalls{0};
+        double seconds{0};
+    };
+
+    ///default preprocessing, inputs are used as they are
+    struct no_normalize
+    {
+        void operator()(inputs_t&) const noexcept
+        {
+        }
+    };
+
+    explicit async_trainer(Net& net, const size_t stage_depth = 2, const size_t metrics_depth = 2) :
+        net(net),
+        stage_slots(std::max<size_t>(1, stage_depth)),
+        metrics_slots(std::max<size_t>(1, metrics_depth))
+    {
+        static_assert(Batch > 0, "Empty batch.");
+    }
+
+    NO_COPYMOVE(async_trainer);
+    ~async_trainer() = default;
+
+    ///trains until source is exhausted. Source is called on stage thread as bool source(inputs_t&, targets_t&),
+    ///it fills whole batch (1 sample per column) and returns false when there is no more data.
+    ///Exception thrown by source or normalize is rethrown here after pipeline stopped.
+    template <class Source, class Normalize = no_normalize>
+    report run(const Float learning_rate, Source&& source, Normalize&& normalize = Normalize())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        utility::spsc_ring<stage_slot*> staged(stage_slots.size());
+        utility::spsc_ring<stage_slot*> stage_free(stage_slots.size());
+        utility::spsc_ring<metrics_slot*> measured(metrics_slots.size());
+        utility::spsc_ring<metrics_slot*> metrics_free(metrics_slots.size());
+        for (auto& s : stage_slots)
+            (void)stage_free.push(&s);
+        for (auto& m : metrics_slots)
+            (void)metrics_free.push(&m);
+
+        report res;
+        std::exception_ptr stage_error;
+        const auto stop = [&]()
+        {
+            staged.close();
+            stage_free.close();
+            measured.close();
+            metrics_free.close();
+        };
+
+        auto stager = utility::startNewRunner([&](const auto should_int)
+        {
+            try
+            {
+                while (!*should_int)
+                {
+                    stage_slot* s = nullptr;
+                    if (!stage_free.try_pop(s))
+                    {
+                        ++res.stage_stalls;
+                        if (!stage_free.pop(s))
+                            break;
+                    }
+                    if (!source(s->inputs, s->targets))
+                        break;
+                    normalize(s->inputs);
+                    if (!staged.push(std::move(s)))
+                        break;
+                }
+            }
+            catch (...)
+            {
+                stage_error = std::current_exception();
+            }
+            staged.close();
+        });
+
+        double loss_sum = 0;
+        size_t correct  = 0;
+        auto meter = utility::startNewRunner([&](const auto)
+        {
+            for (metrics_slot* m = nullptr; measured.pop(m);)
+            {
+                measure(*m, loss_sum, correct);
+                (void)metrics_free.push(std::move(m));
+            }
+        });
+
+        try
+        {
+            for (stage_slot* s = nullptr;;)
+            {
+                bool waited = false;
+                if (!staged.try_pop(s))
+                {
+                    if (!staged.pop(s))
+                        break;
+                    waited = true;
+                }
+                received(res, start, waited);
+                train_step(learning_rate, s->inputs, s->targets, metrics_free, measured, res);
+                (void)stage_free.push(std::move(s));
+            }
+        }
+        catch (...)
+        {
+            stop();
+            stager.reset();
+            meter.reset();
+            throw;
+        }
+
+        //metrics thread takes what is left in the ring and ends
+        measured.close();
+        stager.reset();
+        meter.reset();
+        if (stage_error)
+            std::rethrow_exception(stage_error);
+
+        finish(res, start, loss_sum, correct);
+        return res;
+    }
+
+    ///trains until stream is exhausted, batches of stream are trained in place: no stage thread and no copy of inputs.
+    ///Stream::next() returns pointer to batch with inputs/targets of this Batch (valid until the next call) or nullptr
+    ///at the end, stalls() tells how many times next() waited for batch after the first one (as mnist_aug::batch_stream,
+    ///which prepares batches on own threads). Exception thrown by next() is rethrown here after pipeline stopped.
+    template <class Stream>
+    report run_stream(const Float learning_rate, Stream& stream)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        utility::spsc_ring<metrics_slot*> measured(metrics_slots.size());
+        utility::spsc_ring<metrics_slot*> metrics_free(metrics_slots.size());
+        for (auto& m : metrics_slots)
+            (void)metrics_free.push(&m);
+
+        report res;
+        double loss_sum = 0;
+        size_t correct  = 0;
+        auto meter = utility::startNewRunner([&](const auto)
+        {
+            for (metrics_slot* m = nullptr; measured.pop(m);)
+            {
+                measure(*m, loss_sum, correct);
+                (void)metrics_free.push(std::move(m));
+            }
+        });
+
+        const size_t stalls_before = stream.stalls();
+        try
+        {
+            while (const auto b = stream.next())
+            {
+                received(res, start, false);
+                train_step(learning_rate, b->inputs, b->targets, metrics_free, measured, res);
+            }
+        }
+        catch (...)
+        {
+            measured.close();
+            metrics_free.close();
+            meter.reset();
+            throw;
+        }
+
+        measured.close();
+        meter.reset();
+
+        res.trainer_stalls = stream.stalls() - stalls_before;
+        finish(res, start, loss_sum, correct);
+        return res;
+    }
+
+    ///source which stacks samples of [first, last) (pair-like, first/second readable by at(r, 0)) in order,
+    ///the last batch is completed by the first samples
+    template <class Iter>
+    static auto range_source(Iter first, Iter last)
+    {
+        const size_t count = static_cast<size_t>(std::distance(first, last));
+        return [first, count, batches = (count + Batch - 1) / Batch, k = size_t{0}](inputs_t& inputs, targets_t& targets) mutable
+        {
+            if (k == batches)
+                return false;
+            for (size_t c = 0; c < Batch; ++c)
+            {
+                const auto& sample = *std::next(first, static_cast<std::ptrdiff_t>((k * Batch + c) % count));
+                for (size_t r = 0; r < Net::inputs_count; ++r)
+                    inputs.at(r, c) = sample.first.at(r, 0);
+                for (size_t r = 0; r < Net::outputs_count; ++r)
+                    targets.at(r, c) = sample.second.at(r, 0);
+            }
+            ++k;
+            return true;
+        };
+    }
+
+    ///source which copies batches of stream with next() returning pointer to batch with inputs/targets
+    ///of this Batch or nullptr at the end (as mnist_aug::batch_stream), for run() with normalize,
+    ///run_stream() trains such batches without copy
+    template <class Stream>
+    static auto stream_source(Stream& stream)
+    {
+        return [&stream](inputs_t& inputs, targets_t& targets)
+        {
+            const auto b = stream.next();
+            if (!b)
+                return false;
+            std::copy(b->inputs.data(), b->inputs.data() + b->inputs.size(), inputs.data());
+            std::copy(b->targets.data(), b->targets.data() + b->targets.size(), targets.data());
+            return true;
+        };
+    }
+private:
+    struct stage_slot
+    {
+        inputs_t inputs;
+        targets_t targets;
+    };
+
+    struct metrics_slot
+    {
+        targets_t outputs;
+        targets_t targets;
+    };
+
+    Net& net;
+    std::vector<stage_slot> stage_slots;
+    std::vector<metrics_slot> metrics_slots;
+    typename Net::template workspace<Batch> ws;
+
+    template <class Inputs, class Targets>
+    void train_step(const Float learning_rate, const Inputs& inputs, const Targets& targets,
+                    utility::spsc_ring<metrics_slot*>& metrics_free, utility::spsc_ring<metrics_slot*>& measured,
+                    report& res)
+    {
+        net.train_batch(ws, learning_rate, inputs, targets);
+
+        metrics_slot* m = nullptr;
+        if (!metrics_free.try_pop(m))
+        {
+            ++res.metrics_stalls;
+            (void)metrics_free.pop(m);
+        }
+        std::copy(ws.output().data(), ws.output().data() + ws.output().size(), m->outputs.data());
+        std::copy(targets.data(), targets.data() + targets.size(), m->targets.data());
+        (void)measured.push(std::move(m));
+        ++res.batches;
+    }
+
+    //batch came to trainer, waited is true if trainer had to wait for it
+    template <class TimePoint>
+    static void received(report& res, const TimePoint& start, const bool waited) noexcept
+    {
+        if (!res.batches)
+            res.first_batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        else
+            res.trainer_stalls += waited;
+    }
+
+    template <class TimePoint>
+    static void finish(report& res, const TimePoint& start, const double loss_sum, const size_t correct) noexcept
+    {
+        res.samples  = res.batches * Batch;
+        res.loss     = res.samples ? loss_sum / static_cast<double>(res.samples * Net::outputs_count) : 0;
+        res.accuracy = res.samples ? static_cast<double>(correct) / static_cast<double>(res.samples) : 0;
+        res.seconds  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static void measure(const metrics_slot& m, double& loss_sum, size_t& correct) noexcept
+    {
+        for (size_t c = 0; c < Batch; ++c)
+        {
+            size_t out_max = 0;
+            size_t tgt_max = 0;
+            for (size_t r = 0; r < Net::outputs_count; ++r)
+            {
+                const double e = static_cast<double>(m.targets.at(r, c)) - static_cast<double>(m.outputs.at(r, c));
+                loss_sum += e * e;
+                if (m.outputs.at(r, c) > m.outputs.at(out_max, c))
+                    out_max = r;
+                if (m.targets.at(r, c) > m.targets.at(tgt_max, c))
+                    tgt_max = r;
+            }
+            correct += out_max == tgt_max;
+        }
+    }
+};
@@ -0,0 +1,603 @@
+//heap allocations are counted by replaced operator new (see nntest::workspace_train_allocations)
+#define HEAP_COUNTER_IMPLEMENT
+#include "heap_counter.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <execution>
+#include <thread>
+#include <numeric>
+#include <random>
+
+#include "simple_nn.h"
+#include "quantized_nn.h"
+#include "half_nn.h"
+#include "mnist_loader.h"
+#include "mnist_augment.h"
+#include "async_trainer.h"
+#include "parallel_trainer.h"
+#include "safe_queue.h"
+#include "ring_buffer.h"
+
+#ifndef NN_DATA_DIR
+#define NN_DATA_DIR "mnist_dataset"
+#endif
+
+//microbenchmarks of kernels, training step, inference and loading.
+//Usage: learning_nn_bench [--format=text|csv|json] [--filter=substring] [--min-time=seconds] [--data=dir]
+namespace bench
+{
+    using steady = std::chrono::steady_clock;
+
+    //value is considered used, so computation producing it is not removed by optimizer
+    template <class T>
+    inline void keep(const T& value) noexcept
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    struct result
+    {
+        std::string name;
+        //time of 1 call of benchmarked function
+        double ns_per_op{0};
+        //work per second in unit
+        double rate{0};
+        std::string unit;
+        size_t iterations{0};
+    };
+
+    struct settings
+    {
+        std::string format{"text"};
+        std::string filter;
+        std::string data_dir{NN_DATA_DIR};
+        double min_time{0.2};
+    };
+
+    class runner
+    {
+    public:
+        explicit runner(const settings& s) :
+            opts(s)
+        {
+        }
+
+        ///runs f repeatedly, work is amount of unit done by 1 call (flops, samples...),
+        ///unit is reported per second, "GFLOP/s" scales work by 1e-9
+        template <class F>
+        void run(const std::string& name, const std::string& unit, const double work, F&& f)
+        {
+            if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+                return;
+
+            //calibration: iterations are doubled until batch takes at least min_time / reps
+            constexpr size_t reps = 5;
+            size_t iters = 1;
+            f();
+            for (;;)
+            {
+                const double t = time(iters, f);
+                if (t >= opts.min_time / reps || iters >= (size_t{1} << 30))
+                    break;
+                iters *= 2;
+            }
+
+            //median of repetitions, so single preemption does not spoil the result
+            std::vector<double> ns(reps);
+            for (auto& v : ns)
+                v = time(iters, f) * 1e9 / static_cast<double>(iters);
+            std::nth_element(ns.begin(), ns.begin() + reps / 2, ns.end());
+
+            result r;
+            r.name       = name;
+            r.ns_per_op  = ns[reps / 2];
+            r.unit       = unit;
+            r.iterations = iters;
+            const double scale = unit.rfind("G", 0) == 0 ? 1e-9 : (unit.rfind("M", 0) == 0 ? 1e-6 : 1.0);
+            r.rate = work * scale / (r.ns_per_op * 1e-9);
+            results.push_back(r);
+
+            if (opts.format == "text")
+                std::cout << std::left << std::setw(40) << r.name << std::right << std::setw(14) << std::fixed
+                          << std::setprecision(1) << r.ns_per_op << " ns/op" << std::setw(14) << std::setprecision(3)
+                          << r.rate << " " << r.unit << std::endl;
+        }
+
+        void report() const
+        {
+            if (opts.format == "csv")
+            {
+                std::cout << "name,ns_per_op,rate,unit,iterations" << std::endl;
+                for (const auto& r : results)
+                    std::cout << r.name << "," << r.ns_per_op << "," << r.rate << "," << r.unit << "," << r.iterations << std::endl;
+            }
+            if (opts.format == "json")
+            {
+                std::cout << "[" << std::endl;
+                for (size_t i = 0; i < results.size(); ++i)
+                {
+                    const auto& r = results[i];
+                    std::cout << "  {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.ns_per_op << ", \"rate\": " << r.rate
+                              << ", \"unit\": \"" << r.unit << "\", \"iterations\": " << r.iterations << "}"
+                              << (i + 1 < results.size() ? "," : "") << std::endl;
+                }
+                std::cout << "]" << std::endl;
+            }
+        }
+
+        const settings& options() const noexcept
+        {
+            return opts;
+        }
+    private:
+        const settings opts;
+        std::vector<result> results;
+
+        template <class F>
+        static double time(const size_t iters, F& f)
+        {
+            const auto start = steady::now();
+            for (size_t i = 0; i < iters; ++i)
+                f();
+            return std::chrono::duration<double>(steady::now() - start).count();
+        }
+    };
+
+    template <class Matrix>
+    void fill(Matrix& m, const float base = 0.5f)
+    {
+        for (size_t i = 0; i < m.size(); ++i)
+            m.data()[i] = base + static_cast<float>(i % 17) * 0.01f;
+    }
+
+    template <size_t R, size_t C, size_t N>
+    void dot(runner& b)
+    {
+        static Matrix2D<float, R, C> a;
+        static Matrix2D<float, C, N> x;
+        static Matrix2D<float, R, N> y;
+        fill(a);
+        fill(x);
+
+        std::ostringstream name;
+        name << "dot " << R << "x" << C << " * " << C << "x" << N;
+        b.run(name.str(), "GFLOP/s", 2.0 * R * C * N, [&]()
+        {
+            a.dot(x, y);
+            keep(y);
+        });
+    }
+
+    template <size_t R, size_t C, size_t N>
+    void tdot(runner& b)
+    {
+        static Matrix2D<float, R, C> a;
+        static Matrix2D<float, R, N> x;
+        static Matrix2D<float, C, N> y;
+        fill(a);
+        fill(x);
+
+        std::ostringstream name;
+        name << "tdot " << R << "x" << C << "^T * " << R << "x" << N;
+        b.run(name.str(), "GFLOP/s", 2.0 * R * C * N, [&]()
+        {
+            a.tdot(x, y);
+            keep(y);
+        });
+    }
+
+    void kernels(runner& b)
+    {
+        dot<200, 784, 1>(b);
+        dot<200, 200, 1>(b);
+        dot<10, 200, 1>(b);
+        dot<200, 784, 32>(b);
+        dot<200, 200, 64>(b);
+        dot<256, 256, 256>(b);
+        tdot<200, 200, 1>(b);
+        tdot<10, 200, 1>(b);
+        tdot<200, 200, 64>(b);
+
+        static Matrix2D<float, 200, 784> m1;
+        static Matrix2D<float, 200, 784> m2;
+        static Matrix2D<float, 200, 784> m3;
+        static Matrix2D<float, 784, 200> mt;
+        fill(m1);
+        fill(m2, 0.25f);
+        fill(m3, 0.125f);
+        constexpr double elements = 200.0 * 784.0;
+
+        b.run("elementwise 200x784 a += b * c", "GFLOP/s", 2 * elements, [&]()
+        {
+            m1 += m2 * m3;
+            keep(m1);
+        });
+        b.run("elementwise 200x784 c = a * b", "GFLOP/s", elements, [&]()
+        {
+            m3 = m1 * m2;
+            keep(m3);
+        });
+        b.run("transpose 200x784", "Melem/s", elements, [&]()
+        {
+            m1.transpose(mt);
+            keep(mt);
+        });
+    }
+
+    template <class Policy>
+    void activation(runner& b, const std::string& name)
+    {
+        constexpr size_t count = 4096;
+        static std::vector<float> src(count);
+        static std::vector<float> dst(count);
+        for (size_t i = 0; i < count; ++i)
+            src[i] = static_cast<float>(i) / count * 8.f - 4.f;
+
+        b.run("activation " + name + " forward x4096", "Melem/s", count, [&]()
+        {
+            Policy::template forward<vmath::accuracy::high>(src.data(), dst.data(), count);
+            keep(dst);
+        });
+        b.run("activation " + name + " backward x4096", "Melem/s", count, [&]()
+        {
+            Policy::backward(src.data(), dst.data(), count);
+            keep(dst);
+        });
+    }
+
+    void activations(runner& b)
+    {
+        activation<act::sigmoid>(b, "sigmoid");
+        activation<act::tanh>(b, "tanh");
+        activation<act::relu>(b, "relu");
+    }
+
+    void network(runner& b)
+    {
+        using net_t = SimpleLayeredNN<float, 784, 200, 200, 10>;
+        static net_t nn;
+        nn.random_weights();
+
+        static VectorRow<float, 784> inputs;
+        static VectorRow<float, 10> targets;
+        fill(inputs, 0.01f);
+        targets.data()[3] = 0.99f;
+
+        static net_t::workspace<> ws;
+        b.run("train 784-200-200-10", "samples/s", 1, [&]()
+        {
+            nn.train(ws, 0.001f, inputs, targets);
+        });
+
+        //the same step with nn::profiling enabled, difference is cost of the counters
+        using profiled_t = SimpleLayeredNN<nn::config<float, nn::profiling<true>>, 784, 200, 200, 10>;
+        static profiled_t pnn;
+        pnn.random_weights();
+        static profiled_t::workspace<> pws;
+        b.run("train profiled 784-200-200-10", "samples/s", 1, [&]()
+        {
+            pnn.train(pws, 0.001f, inputs, targets);
+        });
+
+        constexpr size_t batch = 32;
+        static Matrix2D<float, 784, batch> binputs;
+        static Matrix2D<float, 10, batch> btargets;
+        fill(binputs, 0.01f);
+        static net_t::workspace<batch> bws;
+        b.run("train_batch<32> 784-200-200-10", "samples/s", batch, [&]()
+        {
+            nn.train_batch(bws, 0.001f, binputs, btargets);
+        });
+
+        b.run("query 784-200-200-10", "samples/s", 1, [&]()
+        {
+            keep(nn.query(inputs));
+        });
+
+        constexpr size_t count = 1024;
+        static std::vector<float> many(count * net_t::inputs_count, 0.5f);
+        static std::vector<float> outs(count * net_t::outputs_count);
+        b.run("query_batch x1024 784-200-200-10", "samples/s", count, [&]()
+        {
+            nn.query_batch(many.data(), count, outs.data());
+            keep(outs);
+        });
+
+        //the same batches through pipeline: staging and metrics run on other threads
+        static async_trainer<net_t, batch> async(nn);
+        constexpr size_t async_batches = 16;
+        b.run("async_trainer<32> x16 784-200-200-10", "samples/s", batch * async_batches, [&]()
+        {
+            size_t k = 0;
+            keep(async.run(0.001f, [&k](auto& in, auto& tg)
+            {
+                std::copy(binputs.data(), binputs.data() + binputs.size(), in.data());
+                std::copy(btargets.data(), btargets.data() + btargets.size(), tg.data());
+                return k++ < async_batches;
+            }));
+        });
+
+        //the same batches taken in place from stream, no staging thread and no copy
+        struct fixed_stream
+        {
+            struct batch_t
+            {
+                const decltype(binputs)& inputs;
+                const decltype(btargets)& targets;
+            };
+            batch_t b{binputs, btargets};
+            size_t k{0};
+
+            const batch_t* next() noexcept
+            {
+                return k++ < async_batches ? &b : nullptr;
+            }
+
+            size_t stalls() const noexcept
+            {
+                return 0;
+            }
+        };
+        b.run("async run_stream<32> x16 784-200-200-10", "samples/s", batch * async_batches, [&]()
+        {
+            fixed_stream stream;
+            keep(async.run_stream(0.001f, stream));
+        });
+
+        //epoch of 256 samples split between team of pool threads, batches of 8 per worker
+        using sample_t = std::pair<VectorRow<float, 784>, VectorRow<float, 10>>;
+        static std::vector<sample_t> epoch(256, sample_t{inputs, targets});
+        static net_t pnet;
+        pnet.random_weights(1);
+        static parallel_trainer<net_t> sharded(pnet, parallel_trainer<net_t>::mode::sharded);
+        b.run("parallel sharded x256 784-200-200-10", "samples/s", epoch.size(), [&]()
+        {
+            sharded.train_epoch<8>(0.001f, epoch);
+        });
+        static parallel_trainer<net_t> hogwild(pnet, parallel_trainer<net_t>::mode::hogwild);
+        b.run("parallel hogwild x256 784-200-200-10", "samples/s", epoch.size(), [&]()
+        {
+            hogwild.train_epoch<8>(0.001f, epoch);
+        });
+
+        static const quantized_nn<net_t> qnn(nn);
+        b.run("quantized query 784-200-200-10", "samples/s", 1, [&]()
+        {
+            keep(qnn.query(inputs));
+        });
+
+        static const half_nn<net_t> hnn(nn);
+        b.run("bf16 query 784-200-200-10", "samples/s", 1, [&]()
+        {
+            keep(hnn.query(inputs));
+        });
+    }
+
+    //producer thread sends count values to the calling thread, batch 1 is item by item transfer
+    template <class Queue>
+    size_t transfer(Queue& q, const size_t count, const size_t batch)
+    {
+        std::thread producer([&q, count, batch]()
+        {
+            std::vector<size_t> items(batch);
+            for (size_t i = 0; i < count; i += batch)
+            {
+                std::iota(items.begin(), items.end(), i);
+                q.push_n(items.data(), batch);
+            }
+            q.close();
+        });
+
+        size_t sum = 0;
+        std::vector<size_t> items(batch);
+        while (const size_t n = q.pop_n(items.data(), batch))
+            sum = std::accumulate(items.begin(), items.begin() + static_cast<std::ptrdiff_t>(n), sum);
+        producer.join();
+        return sum;
+    }
+
+    void queues(runner& b)
+    {
+        constexpr size_t count = 1 << 16;
+        constexpr size_t depth = 256;
+
+        b.run("SafeQueue transfer x65536", "Mitems/s", count, [&]()
+        {
+            SafeQueue<size_t> q;
+            std::thread producer([&q]()
+            {
+                for (size_t i = 0; i < count; ++i)
+                    (void)q.pushSync(size_t{i}, depth);
+                q.close();
+            });
+            size_t sum = 0;
+            size_t v;
+            while (q.popSync(v))
+                sum += v;
+            producer.join();
+            keep(sum);
+        });
+        for (const size_t batch : {size_t{1}, size_t{16}})
+        {
+            const std::string suffix = " transfer x65536 batch " + std::to_string(batch);
+            b.run("spsc_ring" + suffix, "Mitems/s", count, [&]()
+            {
+                utility::spsc_ring<size_t> q(depth);
+                keep(transfer(q, count, batch));
+            });
+            b.run("mpmc_ring" + suffix, "Mitems/s", count, [&]()
+            {
+                utility::mpmc_ring<size_t> q(depth);
+                keep(transfer(q, count, batch));
+            });
+        }
+    }
+
+    //the same loop split into chunks: persistent pool vs new thread per chunk
+    void threads(runner& b)
+    {
+        static constexpr size_t count = 1 << 20;
+        static constexpr size_t grain = 1 << 16;
+        static std::vector<float> v(count, 1.f);
+        const auto body = [](const size_t from, const size_t to)
+        {
+            for (size_t i = from; i < to; ++i)
+                v[i] = v[i] * 0.5f + 0.5f;
+        };
+
+        b.run("thread_pool parallel_for x1M", "Melem/s", count, [&]()
+        {
+            utility::thread_pool::global().parallel_for(count, grain, body);
+            keep(v);
+        });
+        b.run("startNewRunner per chunk x1M", "Melem/s", count, [&]()
+        {
+            std::vector<std::shared_ptr<std::thread>> runners;
+            for (size_t from = 0; from < count; from += grain)
+                runners.push_back(utility::startNewRunner([&body, from](const auto)
+                {
+                    body(from, from + grain);
+                }));
+            runners.clear();
+            keep(v);
+        });
+    }
+
+    //weight initialization and shuffling with counter-based generator
+    void random(runner& b)
+    {
+        constexpr size_t count = 1 << 20;
+        static std::vector<float> v(count);
+        b.run("fill_normal x1M", "Melem/s", count, [&]()
+        {
+            rnd_nn::fill_normal(v.data(), count, 0.f, 1.f, 1);
+            keep(v);
+        });
+        b.run("mt19937_64 normal_distribution x1M", "Melem/s", count, [&]()
+        {
+            std::mt19937_64 rng(1);
+            std::normal_distribution<float> dis(0.f, 1.f);
+            for (auto& x : v)
+                x = dis(rng);
+            keep(v);
+        });
+        b.run("permutation x1M", "Melem/s", count, [&]()
+        {
+            keep(rnd_nn::permutation(count, 1));
+        });
+        b.run("bijection x1M", "Melem/s", count, [&]()
+        {
+            const rnd_nn::bijection order(count, 1);
+            size_t sum = 0;
+            for (size_t i = 0; i < count; ++i)
+                sum += order(i);
+            keep(sum);
+        });
+
+        static SimpleLayeredNN<float, 784, 200, 200, 10> nn;
+        b.run("random_weights 784-200-200-10", "Mweights/s", 784 * 200 + 200 * 200 + 200 * 10, [&]()
+        {
+            nn.random_weights(1);
+        });
+    }
+
+    void loading(runner& b)
+    {
+        const std::string file = b.options().data_dir + "/mnist_train_100.csv";
+        size_t samples = 0;
+        try
+        {
+            samples = mnist_loader(file).train_data().size();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Loading benchmarks skipped: " << e.what() << std::endl;
+            return;
+        }
+
+        b.run("mnist_loader csv", "samples/s", static_cast<double>(samples), [&]()
+        {
+            const mnist_loader l(file);
+            keep(l);
+        });
+        b.run("mnist_loader csv parallel", "samples/s", static_cast<double>(samples), [&]()
+        {
+            const mnist_loader l(std::execution::par, file);
+            keep(l);
+        });
+        b.run("mnist_stream csv", "samples/s", static_cast<double>(samples), [&]()
+        {
+            mnist_stream src(file);
+            mnist_stream::train_value v;
+            while (src.next(v))
+                keep(v);
+        });
+
+        //preparing of 10 shuffled and augmented epochs, trainer side only takes batches
+        const mnist_loader data(file);
+        b.run("batch_stream augment x10 epochs batch 16", "samples/s", 10.0 * samples, [&]()
+        {
+            mnist_aug::options opts;
+            opts.epochs = 10;
+            mnist_aug::batch_stream<16, std::vector<mnist_loader::train_value>> src(data.train_data(), opts);
+            while (const auto v = src.next())
+                keep(*v);
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::settings s;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto value = [&arg]()
+        {
+            return arg.substr(arg.find('=') + 1);
+        };
+
+        if (arg.rfind("--format=", 0) == 0)
+            s.format = value();
+        else if (arg.rfind("--filter=", 0) == 0)
+            s.filter = value();
+        else if (arg.rfind("--min-time=", 0) == 0)
+            s.min_time = std::stod(value());
+        else if (arg.rfind("--data=", 0) == 0)
+            s.data_dir = value();
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--format=text|csv|json] [--filter=substring] [--min-time=seconds]"
+                      << " [--data=dir]" << std::endl;
+            return 1;
+        }
+    }
+    if (s.format != "text" && s.format != "csv" && s.format != "json")
+    {
+        std::cerr << "Unknown format: " << s.format << std::endl;
+        return 1;
+    }
+
+    bench::runner b(s);
+    if (s.format == "text")
+        std::cout << "heap allocations in 50 steps: train " << nntest::workspace_train_allocations<1>()
+                  << ", train_batch<32> " << nntest::workspace_train_allocations<32>() << std::endl
+                  << "parallel_trainer modes which did not converge: " << nntest::parallel_trainer_failures() << std::endl;
+    bench::kernels(b);
+    bench::activations(b);
+    bench::network(b);
+    bench::queues(b);
+    bench::threads(b);
+    bench::random(b);
+    bench::loading(b);
+    b.report();
+
+    return 0;
+}
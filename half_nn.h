@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include "cm_ctors.h"
+#include "matrix2d.h"
+#include "parallel.h"
+#include "gemm.h"
+#include "half.h"
+#include "simple_nn.h"
+
+///inference-only copy of trained SimpleLayeredNN with weights kept in 16 bits only (fp::bf16 or fp::f16).
+///SimpleLayeredNN with nn::storage keeps fp32 master weights next to the 16 bit copy for training,
+///this one has no master, so it takes half of memory of fp32 network (and a quarter of mixed one).
+///Weights are converted in registers and accumulated in float, as single sample passes of mixed network do,
+///so query() gives the same outputs as query() of mixed network built with the same S.
+template <class Net, class S = std::conditional_t<Net::mixed_precision, typename Net::storage_t, fp::bf16>>
+class half_nn
+{
+public:
+    using Float     = typename Net::Float;
+    using storage_t = S;
+
+    static_assert(std::is_same<Float, float>::value && fp::is_half_v<S>, "16 bit weights are supported for float network only.");
+
+    static constexpr size_t layers_count  = Net::layers_count;
+    static constexpr size_t inputs_count  = Net::inputs_count;
+    static constexpr size_t outputs_count = Net::outputs_count;
+
+    explicit half_nn(const Net& net)
+    {
+        convert_layers(net, std::make_index_sequence<layers_count - 1>());
+    }
+
+    ~half_nn() = default;
+    DEFAULT_COPYMOVE(half_nn);
+
+    ///single sample, outputs receive outputs_count values
+    void query(const Float* inputs, Float* outputs) const noexcept
+    {
+        forward(inputs, outputs, std::make_index_sequence<layers_count - 1>());
+    }
+
+    VectorRow<Float, outputs_count> query(const VectorRow<Float, inputs_count>& inputs) const noexcept
+    {
+        VectorRow<Float, outputs_count> res;
+        query(inputs.data(), res.data());
+        return res;
+    }
+
+    ///count samples stored one after another, as SimpleLayeredNN::query_batch() takes them
+    void query_batch(const Float* inputs, const size_t count, Float* outputs) const
+    {
+        constexpr size_t grain = 64;
+        par::for_chunks(count, grain, [&](const size_t from, const size_t to)
+        {
+            for (size_t s = from; s < to; ++s)
+                query(inputs + s * inputs_count, outputs + s * outputs_count);
+        });
+    }
+
+    ///bytes taken by weights
+    size_t weights_bytes() const noexcept
+    {
+        size_t bytes = 0;
+        for (const auto& l : layers)
+            bytes += l.size() * sizeof(S);
+        return bytes;
+    }
+private:
+    using layer = AlignedVector<S, prefFloatsAlign()>;
+    std::array<layer, layers_count - 1> layers;
+
+    static constexpr size_t max_width()
+    {
+        size_t m = 0;
+        for (const size_t s : Net::layer_sizes)
+            m = std::max(m, s);
+        return m;
+    }
+
+    template <size_t ...I>
+    void convert_layers(const Net& net, std::index_sequence<I...>)
+    {
+        ((layers[I].resize(std::get<I>(net.layers_weights()).size()),
+          fp::convert(std::get<I>(net.layers_weights()).data(), layers[I].data(), layers[I].size())), ...);
+    }
+
+    template <size_t ...I>
+    void forward(const Float* inputs, Float* outputs, std::index_sequence<I...>) const noexcept
+    {
+        std::array<Float, max_width()> ping;
+        std::array<Float, max_width()> pong;
+
+        const Float* src = inputs;
+        const auto step = [&](auto index)
+        {
+            constexpr size_t L = decltype(index)::value;
+            Float* dst = L == layers_count - 2 ? outputs : (src == ping.data() ? pong.data() : ping.data());
+            forward_layer<L>(src, dst);
+            src = dst;
+        };
+        (step(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    template <size_t L>
+    void forward_layer(const Float* src, Float* dst) const noexcept
+    {
+        constexpr size_t rows = Net::layer_sizes[L + 1];
+        constexpr size_t cols = Net::layer_sizes[L];
+        gemm::gemv(rows, cols, Float(1), layers[L].data(), cols, src, Float(0), dst);
+
+        using policy_t = typename Net::activations_t::template layer<L>;
+        policy_t::template forward<Net::accuracy>(dst, dst, rows);
+    }
+};
+
+namespace nntest
+{
+    //outputs of half_nn which differ in any bit from query() of mixed precision network it was built from
+    /*
+    Expecting result: 0
+    */
+    template <class S = fp::bf16>
+    inline size_t half_query_mismatches()
+    {
+        using net_t = SimpleLayeredNN<nn::config<float, nn::storage<S>>, 784, 200, 200, 10>;
+        net_t nn;
+        nn.random_weights(5);
+        const half_nn<net_t> hnn(nn);
+
+        VectorRow<float, net_t::inputs_count> inputs;
+        size_t mismatches = 0;
+        for (size_t k = 1; k <= 8; ++k)
+        {
+            for (size_t i = 0; i < inputs.size(); ++i)
+                inputs.data()[i] = static_cast<float>((i * k) % 255) / 255.f;
+            const auto a = nn.query(inputs);
+            const auto b = hnn.query(inputs);
+            for (size_t i = 0; i < a.size(); ++i)
+                mismatches += a.data()[i] != b.data()[i];
+        }
+        return mismatches;
+    }
+}
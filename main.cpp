@@ -1,23 +1,68 @@
 #include "simple_nn.h"
 #include <iostream>
 #include <thread>
+#include <filesystem>
 #include "mnist_loader.h"
+#include "mnist_augment.h"
+#include "async_trainer.h"
+#include "nn_cereal.h"
+#include "quantized_nn.h"
 
-int main()
+#ifndef NN_DATA_DIR
+#define NN_DATA_DIR "mnist_dataset"
+#endif
+
+//optional argument is directory with mnist csv files, default one is set by CMake
+int main(int argc, char** argv)
 {
+    const std::string data_dir = argc > 1 ? argv[1] : NN_DATA_DIR;
+
     SimpleLayeredNN<mnist_loader::samples_t, mnist_loader::inputs_size,
                     20 * mnist_loader::outputs_size, 20 * mnist_loader::outputs_size, mnist_loader::outputs_size> nn;
-    nn.random_weights();
 
-    mnist_loader srcf("/home/alex/Work/learning_nn/mnist_dataset/mnist_train_100.csv");
-    const auto& src = srcf.train_data();
-    for (int epoche =0; epoche < 5; ++epoche)
-        for (const auto& ex : src)
+    //trained network is stored, so next runs start from it instead of training again. Network of other
+    //topology (layer sizes changed) is trained again and overwritten, broken file is an error and is kept
+    const std::string model_file = "mnist_nn.bin";
+    bool loaded = false;
+    if (std::filesystem::exists(model_file))
+    {
+        try
+        {
+            nn::load_model(nn, model_file);
+            loaded = true;
+            std::cout << "Loaded trained network: " << model_file << std::endl;
+        }
+        catch (const nn::topology_mismatch& e)
+        {
+            std::cout << e.what() << ", training new one." << std::endl;
+        }
+        catch (const std::exception& e)
         {
-            nn.train(0.3f, ex.first, ex.second);
+            std::cerr << e.what() << std::endl;
+            return 1;
         }
+    }
+    if (!loaded)
+    {
+        std::cout << "Training network, it is saved into " << model_file << std::endl;
+        nn.random_weights();
+
+        //samples are shuffled and augmented each epoch by worker threads while training goes
+        const mnist_loader train(std::execution::par, data_dir + "/mnist_train_100.csv");
+        mnist_aug::options opts;
+        opts.epochs = 5;
+        mnist_aug::batch_stream<1, std::vector<mnist_loader::train_value>> src(train.train_data(), opts);
 
-    mnist_loader test("/home/alex/Work/learning_nn/mnist_dataset/mnist_test_10.csv");
+        //batches of stream are trained in place and measured on another thread while this one trains
+        async_trainer<decltype(nn), 1> trainer(nn);
+        const auto r = trainer.run_stream(0.3f, src);
+        std::cout << "Trained " << r.samples << " samples in " << r.seconds << "s, loss: " << r.loss
+                  << ", accuracy: " << r.accuracy << ", first batch after " << r.first_batch_seconds
+                  << "s, then trainer waited for data " << r.trainer_stalls << " times." << std::endl;
+        nn::save_model(nn, model_file);
+    }
+
+    mnist_loader test(data_dir + "/mnist_test_10.csv");
     for (const auto& t : test.train_data())
     {
         const auto r = nn.query(t.first);
@@ -25,5 +70,9 @@ int main()
         std::cout << "Recognized: " << mnist_loader::parse_output(r) << std::endl << std::endl;
     }
 
+    //int8 copy for serving, checked against float network on the same test set
+    const quantized_nn<decltype(nn)> qnn(nn);
+    std::cout << quantization_report::compare(nn, qnn, test.train_data().begin(), test.train_data().end());
+
     return 0;
 }
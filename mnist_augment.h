@@ -0,0 +1,303 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "cm_ctors.h"
+#include "matrix2d.h"
+#include "ring_buffer.h"
+#include "runners.h"
+#include "rnd_nn.h"
+#include "mnist_loader.h"
+
+//per-epoch shuffling and augmentation of mnist images on worker threads, trainer only takes ready batches.
+//Each sample of each epoch is shifted, rotated (1 bilinear warp) and noised, so network sees new images
+//every epoch. Random values depend on (seed, epoch, position in epoch) only: content of batch k is the same
+//with any amount of workers, batches are returned in order.
+namespace mnist_aug
+{
+    using samples_t = mnist_loader::samples_t;
+    constexpr size_t inputs_size  = mnist_loader::inputs_size;
+    constexpr size_t outputs_size = mnist_loader::outputs_size;
+
+    //images are square
+    constexpr size_t side = 28;
+    static_assert(side * side == inputs_size, "Image is expected to be 28x28.");
+
+    struct options
+    {
+        ///epochs produced, sample order is new random bijection each epoch (if shuffle)
+        size_t epochs{1};
+        bool shuffle{true};
+        ///max shift by x and y in pixels, uniform in [-max_shift; max_shift]
+        float max_shift{2.f};
+        ///max rotation in degrees, uniform in [-max_rotation; max_rotation]
+        float max_rotation{10.f};
+        ///stddev of gaussian noise added to each pixel
+        float noise{0.02f};
+        ///threads preparing batches, 0 means utility::thread_pool::default_threads()
+        size_t workers{0};
+        ///batches prepared ahead per worker
+        size_t depth{4};
+        std::uint64_t seed{rnd_nn::master_seed().load()};
+    };
+
+    ///Batch samples stacked by columns, as SimpleLayeredNN::train_batch() takes them
+    template <size_t Batch>
+    struct batch
+    {
+        Matrix2D<samples_t, inputs_size, Batch>  inputs;
+        Matrix2D<samples_t, outputs_size, Batch> targets;
+        size_t epoch{0};
+        ///index of batch in its epoch
+        size_t index{0};
+    };
+
+    ///one 28x28 image: src shifted by (dx, dy) and rotated by angle (radians) around center, then noise[i] is added.
+    ///Pixels coming from outside of the image are background (value of black pixel).
+    inline void warp(const samples_t* src, samples_t* dst, const float dx, const float dy, const float angle,
+                     const samples_t* noise) noexcept
+    {
+        const samples_t black = mnist_loader::scale_pixel(0);
+        const samples_t white = mnist_loader::scale_pixel(255);
+
+        //source with black border: 1 pixel before and 2 after, so clamped coordinates are always inside
+        constexpr size_t pw = side + 3;
+        samples_t padded[pw * pw];
+        std::fill(padded, padded + pw * pw, black);
+        for (size_t y = 0; y < side; ++y)
+            std::copy(src + y * side, src + (y + 1) * side, padded + (y + 1) * pw + 1);
+
+        //inverse mapping: destination pixel is taken from rotated back and unshifted position of source
+        const float c    = (side - 1) * 0.5f;
+        const float cs   = std::cos(angle);
+        const float sn   = std::sin(angle);
+        const float lim  = static_cast<float>(side);
+        for (size_t y = 0; y < side; ++y)
+        {
+            const float v = static_cast<float>(y) - c - dy;
+            for (size_t x = 0; x < side; ++x)
+            {
+                const float u = static_cast<float>(x) - c - dx;
+                //outside of [-1; side] all 4 neighbours are border, shifted by 1 into padded coordinates,
+                //which are not negative, so truncation is floor
+                const float sx = std::min(lim, std::max(-1.f, cs * u + sn * v + c)) + 1.f;
+                const float sy = std::min(lim, std::max(-1.f, cs * v - sn * u + c)) + 1.f;
+
+                const int ix = static_cast<int>(sx);
+                const int iy = static_cast<int>(sy);
+                const float ax = sx - static_cast<float>(ix);
+                const float ay = sy - static_cast<float>(iy);
+                const samples_t* p = padded + iy * static_cast<int>(pw) + ix;
+
+                const float top = p[0] + (p[1] - p[0]) * ax;
+                const float bot = p[pw] + (p[pw + 1] - p[pw]) * ax;
+                const float val = top + (bot - top) * ay + noise[y * side + x];
+                dst[y * side + x] = std::min(white, std::max(black, static_cast<samples_t>(val)));
+            }
+        }
+    }
+
+    ///Produces options::epochs epochs of augmented batches out of samples (random access container of pair-like
+    ///samples, first/second readable by at(r, 0), as mnist_loader::train_data() or mnist_bin datasets).
+    ///Batch k is prepared by worker k % workers, each worker has own spsc rings (ready and free batches),
+    ///so trainer just takes the next prepared batch and returns the previous one for reuse, nothing is allocated.
+    ///Epoch has ceil(size / Batch) batches, the last one is completed by the first samples of the epoch order.
+    ///Samples must outlive the stream.
+    template <size_t Batch, class Samples>
+    class batch_stream
+    {
+    public:
+        using batch_t = batch<Batch>;
+
+        batch_stream(const Samples& samples, const options& opts = options()) :
+            samples(samples),
+            opts(opts),
+            per_epoch((std::size(samples) + Batch - 1) / Batch),
+            total(per_epoch * opts.epochs)
+        {
+            static_assert(Batch > 0, "Empty batch.");
+            const size_t count = std::max<size_t>(1, opts.workers ? opts.workers : utility::thread_pool::default_threads());
+            const size_t depth = std::max<size_t>(1, opts.depth);
+
+            workers.reserve(count);
+            for (size_t w = 0; w < count; ++w)
+            {
+                workers.push_back(std::make_unique<worker>(depth));
+                for (auto& b : workers.back()->batches)
+                    (void)workers.back()->free.push(&b);
+            }
+            for (size_t w = 0; w < count; ++w)
+                workers[w]->runner = utility::startNewRunner([this, w](const auto should_int)
+                {
+                    produce(w, *should_int);
+                });
+        }
+
+        NO_COPYMOVE(batch_stream);
+
+        ~batch_stream()
+        {
+            //releases workers waiting for free batches
+            for (auto& w : workers)
+            {
+                w->free.close();
+                w->ready.close();
+            }
+            for (auto& w : workers)
+                w->runner.reset();
+        }
+
+        ///waits for the next batch, returns nullptr after the last one. Batch stays valid until the next call,
+        ///then it is given back to its worker
+        const batch_t* next()
+        {
+            if (current)
+            {
+                (void)workers[taken_count % workers.size()]->free.push(std::move(current));
+                current = nullptr;
+                ++taken_count;
+            }
+            if (taken_count == total)
+                return nullptr;
+
+            auto& ready = workers[taken_count % workers.size()]->ready;
+            if (!ready.try_pop(current))
+            {
+                if (!ready.pop(current))
+                    return nullptr;
+                //waiting for the first batch is filling of the pipeline, not a stall
+                stall_count += taken_count > 0;
+            }
+            return current;
+        }
+
+        size_t batches_per_epoch() const noexcept
+        {
+            return per_epoch;
+        }
+
+        ///times next() found no prepared batch and received it after waiting, the first batch is not counted,
+        ///0 means augmentation was fully hidden
+        size_t stalls() const noexcept
+        {
+            return stall_count;
+        }
+
+        size_t workers_count() const noexcept
+        {
+            return workers.size();
+        }
+    private:
+        struct worker
+        {
+            std::vector<batch_t> batches;
+            utility::spsc_ring<batch_t*> free;
+            utility::spsc_ring<batch_t*> ready;
+            std::shared_ptr<std::thread> runner;
+
+            explicit worker(const size_t depth) :
+                batches(depth),
+                free(depth),
+                ready(depth)
+            {
+            }
+        };
+
+        //independent random sequences out of 1 seed
+        enum stream_kind : std::uint64_t
+        {
+            order_stream = 0,
+            params_stream,
+            noise_stream,
+        };
+
+        const Samples& samples;
+        const options opts;
+        const size_t per_epoch;
+        const size_t total;
+        std::vector<std::unique_ptr<worker>> workers;
+
+        //consumer side
+        batch_t* current{nullptr};
+        size_t taken_count{0};
+        size_t stall_count{0};
+
+        std::uint64_t seed_of(const stream_kind kind) const noexcept
+        {
+            return opts.seed ^ (0x9E3779B97F4A7C15ull * (kind + 1));
+        }
+
+        void produce(const size_t w, const std::atomic<bool>& should_int)
+        {
+            auto& self = *workers[w];
+            const size_t count = std::size(samples);
+
+            //order of the epoch is computed per position without table, so workers neither share nor repeat work
+            rnd_nn::bijection order(count, seed_of(order_stream), total);
+            size_t order_epoch = total;
+
+            std::vector<samples_t> source(inputs_size);
+            std::vector<samples_t> image(inputs_size);
+            std::vector<samples_t> noise(inputs_size, 0);
+            for (size_t k = w; k < total && !should_int; k += workers.size())
+            {
+                batch_t* b = nullptr;
+                if (!self.free.pop(b))
+                    break;
+
+                b->epoch = k / per_epoch;
+                b->index = k % per_epoch;
+                if (order_epoch != b->epoch)
+                {
+                    order_epoch = b->epoch;
+                    order = rnd_nn::bijection(count, seed_of(order_stream), order_epoch);
+                }
+
+                for (size_t c = 0; c < Batch; ++c)
+                {
+                    const size_t position = b->index * Batch + c;
+                    const size_t i = position % count;
+                    const auto& sample = samples[opts.shuffle ? order(i) : i];
+                    for (size_t r = 0; r < inputs_size; ++r)
+                        source[r] = sample.first.at(r, 0);
+                    augment(source.data(), k * Batch + c, image.data(), noise.data());
+                    for (size_t r = 0; r < inputs_size; ++r)
+                        b->inputs.at(r, c) = image[r];
+                    for (size_t r = 0; r < outputs_size; ++r)
+                        b->targets.at(r, c) = sample.second.at(r, 0);
+                }
+
+                if (!self.ready.push(std::move(b)))
+                    break;
+            }
+            self.ready.close();
+        }
+
+        //augmented source image of sample at global position (over all epochs) into image
+        void augment(const samples_t* source, const std::uint64_t position, samples_t* image, samples_t* noise) const
+        {
+            rnd_nn::counter_rng rng(seed_of(params_stream), position);
+            const auto uniform = [&rng](const float limit)
+            {
+                return (static_cast<float>(rng()) * (1.f / 4294967296.f) * 2.f - 1.f) * limit;
+            };
+            const float dx    = uniform(opts.max_shift);
+            const float dy    = uniform(opts.max_shift);
+            const float angle = uniform(opts.max_rotation) * 0.0174532925f;
+            if (opts.noise > 0)
+                rnd_nn::fill_normal(noise, inputs_size, samples_t(0), static_cast<samples_t>(opts.noise),
+                                    seed_of(noise_stream), position);
+
+            if (dx == 0 && dy == 0 && angle == 0 && opts.noise <= 0)
+                std::copy(source, source + inputs_size, image);
+            else
+                warp(source, image, dx, dy, angle, noise);
+        }
+    };
+}
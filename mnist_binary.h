@@ -0,0 +1,433 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+#include "mapped_file.h"
+#include "mnist_loader.h"
+
+//memory mapped datasets: original MNIST IDX files and own packed binary format.
+//Samples are returned as views into mapping (nothing is copied or parsed on load). Like
+//mnist_loader::train_value views have first (inputs) and second (targets) readable by at(r, 0),
+//so they can be passed to SimpleLayeredNN::train_batch() and parallel_trainer directly.
+namespace mnist_bin
+{
+    using samples_t = mnist_loader::samples_t;
+    constexpr size_t inputs_size  = mnist_loader::inputs_size;
+    constexpr size_t outputs_size = mnist_loader::outputs_size;
+
+    ///column of Size values stored contiguously
+    template <class T, size_t Size>
+    class vector_view
+    {
+    private:
+        const T* ptr;
+    public:
+        explicit vector_view(const T* ptr) noexcept :
+            ptr(ptr)
+        {
+        }
+
+        const T& at(const size_t r, const size_t) const noexcept
+        {
+            return ptr[r];
+        }
+
+        const T* begin() const noexcept
+        {
+            return ptr;
+        }
+
+        const T* end() const noexcept
+        {
+            return ptr + Size;
+        }
+    };
+
+    ///raw IDX pixels, scaled into network input on read the same way mnist_loader does
+    class pixels_view
+    {
+    private:
+        const uint8_t* ptr;
+    public:
+        explicit pixels_view(const uint8_t* ptr) noexcept :
+            ptr(ptr)
+        {
+        }
+
+        samples_t at(const size_t r, const size_t) const noexcept
+        {
+            return mnist_loader::scale_pixel(ptr[r]);
+        }
+
+        const uint8_t* raw() const noexcept
+        {
+            return ptr;
+        }
+    };
+
+    ///IDX label as target vector
+    class label_view
+    {
+    private:
+        uint8_t label;
+    public:
+        explicit label_view(const uint8_t label) noexcept :
+            label(label)
+        {
+        }
+
+        samples_t at(const size_t r, const size_t) const noexcept
+        {
+            return static_cast<samples_t>(r == label ? 0.999 : 0.001);
+        }
+
+        uint8_t value() const noexcept
+        {
+            return label;
+        }
+    };
+
+    template <class First, class Second>
+    struct sample_view
+    {
+        First  first;
+        Second second;
+    };
+
+    ///random access iterator over dataset, dereference returns sample view by value
+    template <class Dataset>
+    class dataset_iter
+    {
+    private:
+        const Dataset* ds{nullptr};
+        size_t i{0};
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = decltype(std::declval<const Dataset&>()[0]);
+        using difference_type   = std::ptrdiff_t;
+        using reference         = value_type;
+        using pointer           = void;
+
+        dataset_iter() = default;
+        dataset_iter(const Dataset* ds, const size_t i) noexcept :
+            ds(ds),
+            i(i)
+        {
+        }
+
+        reference operator*() const
+        {
+            return (*ds)[i];
+        }
+
+        reference operator[](const difference_type n) const
+        {
+            return (*ds)[i + n];
+        }
+
+        dataset_iter& operator++() noexcept
+        {
+            ++i;
+            return *this;
+        }
+
+        dataset_iter operator++(int) noexcept
+        {
+            return dataset_iter(ds, i++);
+        }
+
+        dataset_iter& operator--() noexcept
+        {
+            --i;
+            return *this;
+        }
+
+        dataset_iter operator--(int) noexcept
+        {
+            return dataset_iter(ds, i--);
+        }
+
+        dataset_iter& operator += (const difference_type n) noexcept
+        {
+            i += n;
+            return *this;
+        }
+
+        dataset_iter& operator -= (const difference_type n) noexcept
+        {
+            i -= n;
+            return *this;
+        }
+
+        dataset_iter operator + (const difference_type n) const noexcept
+        {
+            return dataset_iter(ds, i + n);
+        }
+
+        dataset_iter operator - (const difference_type n) const noexcept
+        {
+            return dataset_iter(ds, i - n);
+        }
+
+        difference_type operator - (const dataset_iter& it) const noexcept
+        {
+            return static_cast<difference_type>(i) - static_cast<difference_type>(it.i);
+        }
+
+        bool operator ==(const dataset_iter& it) const noexcept
+        {
+            return i == it.i;
+        }
+
+        bool operator !=(const dataset_iter& it) const noexcept
+        {
+            return i != it.i;
+        }
+
+        bool operator <(const dataset_iter& it) const noexcept
+        {
+            return i < it.i;
+        }
+    };
+
+    ///begin()/end()/size() for dataset which has operator[] and count()
+    template <class Dataset>
+    class dataset_range
+    {
+    public:
+        dataset_iter<Dataset> begin() const noexcept
+        {
+            return {self(), 0};
+        }
+
+        dataset_iter<Dataset> end() const noexcept
+        {
+            return {self(), self()->count()};
+        }
+
+        size_t size() const noexcept
+        {
+            return self()->count();
+        }
+    private:
+        const Dataset* self() const noexcept
+        {
+            return static_cast<const Dataset*>(this);
+        }
+    };
+
+    ///pair of IDX files: images (idx3-ubyte) and labels (idx1-ubyte)
+    class idx_dataset : public dataset_range<idx_dataset>
+    {
+    public:
+        using sample_t = sample_view<pixels_view, label_view>;
+
+        idx_dataset(const std::string& images_file, const std::string& labels_file) :
+            images(images_file),
+            labels(labels_file)
+        {
+            const auto img = parse_header(images, 3, images_file);
+            const auto lbl = parse_header(labels, 1, labels_file);
+
+            if (img.dims[1] * img.dims[2] != inputs_size)
+                throw std::runtime_error("Unexpected image size in " + images_file);
+            if (img.dims[0] != lbl.dims[0])
+                throw std::runtime_error("Images and labels count mismatch: " + images_file + ", " + labels_file);
+
+            samples = img.dims[0];
+            pixels  = images.data() + img.offset;
+            marks   = labels.data() + lbl.offset;
+
+            //labels are checked once here, so label_view needs no check (CSV labels: mnist_loader::make_output_vector())
+            for (size_t i = 0; i < samples; ++i)
+                if (marks[i] >= outputs_size)
+                    throw std::out_of_range("Label must be in [0; " + std::to_string(outputs_size - 1) + "], got "
+                                            + std::to_string(marks[i]) + " (sample " + std::to_string(i) + " of "
+                                            + labels_file + ")");
+        }
+
+        NO_COPYMOVE(idx_dataset);
+        ~idx_dataset() = default;
+
+        size_t count() const noexcept
+        {
+            return samples;
+        }
+
+        sample_t operator[](const size_t i) const noexcept
+        {
+            return {pixels_view(pixels + i * inputs_size), label_view(marks[i])};
+        }
+    private:
+        utility::mapped_file images;
+        utility::mapped_file labels;
+        size_t samples{0};
+        const uint8_t* pixels{nullptr};
+        const uint8_t* marks{nullptr};
+
+        struct header
+        {
+            size_t dims[3]{1, 1, 1};
+            size_t offset{0};
+        };
+
+        //magic is 0, 0, type (0x08 = unsigned byte), dimensions count; then big-endian uint32 per dimension
+        static header parse_header(const utility::mapped_file& f, const size_t dims, const std::string& name)
+        {
+            const uint8_t* p = f.data();
+            if (f.size() < 4 + 4 * dims || p[0] != 0 || p[1] != 0 || p[2] != 0x08 || p[3] != dims)
+                throw std::runtime_error("Not an unsigned byte IDX file of " + std::to_string(dims) + " dimension(s): " + name);
+
+            header h;
+            h.offset = 4 + 4 * dims;
+            //product of dimensions must fit into bytes after header, checked by division so it can't overflow
+            const size_t left = f.size() - h.offset;
+            size_t total = 1;
+            for (size_t d = 0; d < dims; ++d)
+            {
+                const uint8_t* v = p + 4 + 4 * d;
+                h.dims[d] = (size_t{v[0]} << 24) | (size_t{v[1]} << 16) | (size_t{v[2]} << 8) | size_t{v[3]};
+                if (h.dims[d] && total > left / h.dims[d])
+                    throw std::runtime_error("Truncated IDX file: " + name);
+                total *= h.dims[d];
+            }
+            return h;
+        }
+    };
+
+    //Packed format: 64 bytes header, then records of inputs + outputs floats (native byte order)
+    //ready to be used by network without any conversion.
+    struct packed_header
+    {
+        char     magic[8]{'N', 'N', 'P', 'A', 'C', 'K', '0', '1'};
+        uint32_t byte_order{0x01020304};
+        uint32_t value_size{sizeof(samples_t)};
+        uint32_t inputs{inputs_size};
+        uint32_t outputs{outputs_size};
+        uint64_t count{0};
+        uint8_t  reserved[32]{};
+    };
+    static_assert(sizeof(packed_header) == 64, "Header must keep records aligned.");
+
+    class packed_dataset : public dataset_range<packed_dataset>
+    {
+    public:
+        using sample_t = sample_view<vector_view<samples_t, inputs_size>, vector_view<samples_t, outputs_size>>;
+        static constexpr size_t record_size = inputs_size + outputs_size;
+
+        explicit packed_dataset(const std::string& file_name) :
+            file(file_name)
+        {
+            packed_header h;
+            const packed_header expected;
+            if (file.size() < sizeof(h))
+                throw std::runtime_error("Truncated packed file: " + file_name);
+            std::memcpy(&h, file.data(), sizeof(h));
+
+            if (std::memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0 || h.byte_order != expected.byte_order
+                || h.value_size != expected.value_size)
+                throw std::runtime_error("Not a packed dataset of this platform: " + file_name);
+            if (h.inputs != inputs_size || h.outputs != outputs_size)
+                throw std::runtime_error("Packed dataset has different sample sizes: " + file_name);
+            //count comes from the file, so it is compared by division: multiplication may overflow
+            if (h.count > (file.size() - sizeof(h)) / (record_size * sizeof(samples_t)))
+                throw std::runtime_error("Truncated packed file: " + file_name);
+
+            samples = h.count;
+            records = reinterpret_cast<const samples_t*>(file.data() + sizeof(h));
+        }
+
+        NO_COPYMOVE(packed_dataset);
+        ~packed_dataset() = default;
+
+        size_t count() const noexcept
+        {
+            return samples;
+        }
+
+        sample_t operator[](const size_t i) const noexcept
+        {
+            const samples_t* r = records + i * record_size;
+            return {vector_view<samples_t, inputs_size>(r), vector_view<samples_t, outputs_size>(r + inputs_size)};
+        }
+
+        ///first record, records follow each other, each is record_size values: inputs then targets
+        const samples_t* data() const noexcept
+        {
+            return records;
+        }
+    private:
+        utility::mapped_file file;
+        size_t samples{0};
+        const samples_t* records{nullptr};
+    };
+
+    ///writes packed dataset sample by sample, count in header is updated by close()
+    class packed_writer
+    {
+    public:
+        explicit packed_writer(const std::string& file_name) :
+            fs(file_name, std::ios::binary | std::ios::trunc)
+        {
+            if (!fs)
+                throw std::runtime_error("Cannot create file: " + file_name);
+            write_header();
+        }
+
+        NO_COPYMOVE(packed_writer);
+
+        ~packed_writer()
+        {
+            try
+            {
+                close();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        ///sample is pair-like with iterable first (inputs) and second (targets), as mnist_loader::train_value
+        template <class Sample>
+        void write(const Sample& s)
+        {
+            std::array<samples_t, inputs_size + outputs_size> record;
+            std::copy_n(s.first.begin(), inputs_size, record.begin());
+            std::copy_n(s.second.begin(), outputs_size, record.begin() + inputs_size);
+            fs.write(reinterpret_cast<const char*>(record.data()), sizeof(record));
+            ++header.count;
+        }
+
+        void close()
+        {
+            if (!fs.is_open())
+                return;
+            fs.seekp(0);
+            write_header();
+            fs.close();
+            if (fs.fail())
+                throw std::runtime_error("Failed to write packed dataset.");
+        }
+
+        size_t count() const noexcept
+        {
+            return header.count;
+        }
+    private:
+        std::ofstream fs;
+        packed_header header;
+
+        void write_header()
+        {
+            fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+    };
+}
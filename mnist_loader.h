@@ -2,9 +2,22 @@
 
 #include <fstream>
 #include <string>
-#include <charconv>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+#include <numeric>
+#include <cstring>
+#include <execution>
+#include <exception>
 #include "csv_reader.h"
+#include "mapped_file.h"
+#include "parallel.h"
 #include "matrix2d.h"
+#include "ring_buffer.h"
+#include "runners.h"
 
 class mnist_loader
 {
@@ -18,29 +31,109 @@ private:
 public:
     mnist_loader(const std::string& file_name)
     {
-        std::ifstream fs(file_name);
-        wholeData.reserve(100);
-        for (const auto& example : csv::range(fs))
+        std::ifstream fs(file_name, std::ios::binary);
+
+        //1 sample per line
+        wholeData.reserve(csv::count_lines(fs));
+        fs.clear();
+        fs.seekg(0);
+
+        csv::int_reader reader(fs);
+        for (train_value val; read_sample(reader, val);)
+            wholeData.push_back(val);
+    }
+
+    ///parallel load: file is mapped and split into byte ranges on line boundaries, ranges are parsed
+    ///by parallel tasks straight into final positions of preallocated data, so order of samples
+    ///is the same as in file
+    mnist_loader(const std::execution::parallel_policy&, const std::string& file_name)
+    {
+        const utility::mapped_file file(file_name);
+        //as sequential load of empty file: no samples
+        if (!file.size())
+            return;
+        const char* begin = reinterpret_cast<const char*>(file.data());
+        const char* end   = begin + file.size();
+
+        //range i is [bounds[i], bounds[i + 1]), each starts right after line end
+        constexpr size_t range_bytes = 1 << 20;
+        const size_t ranges = std::max<size_t>(1, file.size() / range_bytes);
+        std::vector<const char*> bounds(ranges + 1, end);
+        for (size_t i = 0; i < ranges; ++i)
         {
-            const auto get_int = [&example](int index)
+            const char* p = begin + file.size() * i / ranges;
+            if (p != begin && p[-1] != '\n')
             {
-                const auto sv = example[index];
-                int v = -1;
-                std::from_chars(sv.data(), sv.data() + sv.size(), v);
-                return v;
-            };
-            const auto sz = example.size();
-            train_value val;
-            val.second = make_output_vector(get_int(0));
-
-            for (size_t i = 1; i < sz; ++i)
-                *(val.first.begin() + i - 1) = (get_int(i) / static_cast<samples_t>(255))
-                                               * static_cast<samples_t>(0.99) + static_cast<samples_t>(0.01);
-            wholeData.push_back(std::move(val));
+                const auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                p = nl ? nl + 1 : end;
+            }
+            bounds[i] = p;
         }
+
+        //1st sample of each range
+        std::vector<size_t> first(ranges + 1, 0);
+        par::for_chunks(ranges, 1, [&](const size_t from, const size_t to)
+        {
+            for (size_t i = from; i < to; ++i)
+                first[i + 1] = csv::int_memory_reader(bounds[i], bounds[i + 1]).count_rows();
+        });
+        std::partial_sum(first.begin(), first.end(), first.begin());
+
+        //exception must not leave parallel task, error of each range is kept and the 1st one is thrown after
+        std::vector<std::exception_ptr> errors(ranges);
+        wholeData.resize(first.back());
+        par::for_chunks(ranges, 1, [&](const size_t from, const size_t to)
+        {
+            for (size_t i = from; i < to; ++i)
+            {
+                try
+                {
+                    csv::int_memory_reader reader(bounds[i], bounds[i + 1], first[i]);
+                    for (size_t k = first[i]; read_sample(reader, wholeData[k]); ++k);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        });
+        for (const auto& e : errors)
+            if (e)
+                std::rethrow_exception(e);
     }
     ~mnist_loader() = default;
 
+    ///network input out of pixel value [0; 255]
+    static samples_t scale_pixel(const int v) noexcept
+    {
+        return (v / static_cast<samples_t>(255)) * static_cast<samples_t>(0.99) + static_cast<samples_t>(0.01);
+    }
+
+    ///parses next csv line "label,pixel0,...,pixel783" into val, fields are converted straight into
+    ///its buffer; returns false at the end of the data. Reader is csv::int_reader or csv::int_memory_reader.
+    ///Throws csv::parse_error for malformed field and std::out_of_range for label outside of [0; 9]
+    template <class Reader>
+    static bool read_sample(Reader& reader, train_value& val)
+    {
+        int label = -1;
+        samples_t* pixels = val.first.data();
+        const size_t fields = reader.next_row([&label, pixels](const size_t index, const int v)
+        {
+            if (index == 0)
+                label = v;
+            else if (index <= inputs_size)
+                pixels[index - 1] = scale_pixel(v);
+        });
+        if (!fields)
+            return false;
+
+        //missing pixels of short line
+        if (fields <= inputs_size)
+            std::fill(pixels + fields - 1, pixels + inputs_size, static_cast<samples_t>(0));
+        val.second = make_output_vector(label);
+        return true;
+    }
+
     const auto& train_data() const
     {
         return wholeData;
@@ -48,6 +141,9 @@ public:
 
     static VectorRow<samples_t, outputs_size> make_output_vector(int active)
     {
+        if (active < 0 || static_cast<size_t>(active) >= outputs_size)
+            throw std::out_of_range("Label must be in [0; " + std::to_string(outputs_size - 1) + "], got "
+                                    + std::to_string(active));
         VectorRow<samples_t, outputs_size> r;
         std::fill(std::begin(r), std::end(r), static_cast<samples_t>(0.001));
         r.at(active, 0) = static_cast<samples_t>(0.999);
@@ -61,3 +157,106 @@ public:
         return "Value: " + std::to_string(d) + "; with float = " + std::to_string(*it);
     }
 };
+
+///reads the same csv as mnist_loader, but parses it on producer thread into bounded queue,
+///so consumer can start training on the first samples while the rest of file is read.
+///At most queue_depth (rounded up to power of 2) samples are kept in the queue.
+///Samples are passed in batches of up to transfer_size, so threads synchronize once per batch.
+class mnist_stream
+{
+public:
+    using train_value = mnist_loader::train_value;
+
+    static constexpr size_t transfer_size = 16;
+
+    explicit mnist_stream(const std::string& file_name, const size_t queue_depth = 256) :
+        fs(file_name, std::ios::binary),
+        queue(queue_depth),
+        ready(transfer_size)
+    {
+        if (!fs)
+            throw std::runtime_error("Cannot open file: " + file_name);
+
+        producer = utility::startNewRunner([this](const auto should_int)
+        {
+            try
+            {
+                csv::int_reader reader(fs);
+                std::vector<train_value> batch(std::min(transfer_size, queue.capacity()));
+                bool more = true;
+                while (more && !*should_int)
+                {
+                    size_t n = 0;
+                    for (; n < batch.size() && (more = mnist_loader::read_sample(reader, batch[n])); ++n);
+                    if (queue.push_n(batch.data(), n) < n)
+                        break;
+                }
+            }
+            catch (...)
+            {
+                //given to consumer after samples read before the error
+                error = std::current_exception();
+            }
+            queue.close();
+        });
+    }
+
+    NO_COPYMOVE(mnist_stream);
+
+    ~mnist_stream()
+    {
+        //releases producer if it waits for free space
+        queue.close();
+        producer.reset();
+    }
+
+    ///waits for the next sample, returns false when whole file was read.
+    ///Error of parsing is rethrown here after the samples before it
+    [[nodiscard]]
+    bool next(train_value& value)
+    {
+        if (ready_pos == ready_count)
+        {
+            ready_pos   = 0;
+            ready_count = queue.pop_n(ready.data(), ready.size());
+            if (!ready_count)
+                return rethrow_error();
+        }
+        value = std::move(ready[ready_pos++]);
+        return true;
+    }
+
+    ///waits for up to count next samples, returns how many were read (less than count at the end of file)
+    size_t next(train_value* values, const size_t count)
+    {
+        size_t i = 0;
+        for (; i < count && ready_pos < ready_count; ++i)
+            values[i] = std::move(ready[ready_pos++]);
+        while (i < count)
+        {
+            const size_t n = queue.pop_n(values + i, count - i);
+            if (!n)
+                return i ? i : rethrow_error();
+            i += n;
+        }
+        return i;
+    }
+private:
+    std::ifstream fs;
+    utility::spsc_ring<train_value> queue;
+    //consumer side batch taken from queue, next() returns values from it
+    std::vector<train_value> ready;
+    size_t ready_pos{0};
+    size_t ready_count{0};
+    //set by producer before queue is closed
+    std::exception_ptr error;
+    std::shared_ptr<std::thread> producer;
+
+    //queue is closed and empty here, so producer has ended
+    bool rethrow_error() const
+    {
+        if (error)
+            std::rethrow_exception(error);
+        return false;
+    }
+};
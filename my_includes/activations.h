@@ -0,0 +1,123 @@
+#pragma once
+#include <cstddef>
+#include <ratio>
+#include <string>
+
+#include "parallel.h"
+#include "vmath.h"
+
+//activation policies of network layers. Each policy works over arrays and supplies:
+//  forward<A>(src, dst, count)  - dst = f(src)
+//  backward(out, err, count)    - err *= f'(x), where derivative is expressed by output out = f(x),
+//                                 so back propagation does not need to keep x
+//  inverse<A>(src, dst, count)  - dst = f^-1(src), used by reverse query
+//  id()                         - name stored with saved model
+//A is accuracy of transcendental functions, src and dst may be the same.
+namespace act
+{
+    struct sigmoid
+    {
+        static std::string id()
+        {
+            return "sigmoid";
+        }
+
+        template <vmath::accuracy A, class T>
+        static void forward(const T* src, T* dst, const size_t count) noexcept
+        {
+            vmath::sigmoid<A>(src, dst, count);
+        }
+
+        template <class T>
+        static void backward(const T* out, T* err, const size_t count) noexcept
+        {
+            PAR_IVDEP
+            for (size_t i = 0; i < count; ++i)
+                err[i] *= out[i] * (T(1) - out[i]);
+        }
+
+        template <vmath::accuracy A, class T>
+        static void inverse(const T* src, T* dst, const size_t count) noexcept
+        {
+            vmath::logit<A>(src, dst, count);
+        }
+    };
+
+    struct tanh
+    {
+        static std::string id()
+        {
+            return "tanh";
+        }
+
+        template <vmath::accuracy A, class T>
+        static void forward(const T* src, T* dst, const size_t count) noexcept
+        {
+            vmath::tanh<A>(src, dst, count);
+        }
+
+        template <class T>
+        static void backward(const T* out, T* err, const size_t count) noexcept
+        {
+            PAR_IVDEP
+            for (size_t i = 0; i < count; ++i)
+                err[i] *= T(1) - out[i] * out[i];
+        }
+
+        template <vmath::accuracy A, class T>
+        static void inverse(const T* src, T* dst, const size_t count) noexcept
+        {
+            vmath::atanh<A>(src, dst, count);
+        }
+    };
+
+    ///f(x) = x for x > 0, Slope * x otherwise; Slope is std::ratio
+    template <class Slope>
+    struct leaky_relu
+    {
+        static std::string id()
+        {
+            return "leaky_relu(" + std::to_string(Slope::num) + "/" + std::to_string(Slope::den) + ")";
+        }
+
+        template <vmath::accuracy, class T>
+        static void forward(const T* src, T* dst, const size_t count) noexcept
+        {
+            constexpr T slope = slope_v<T>;
+            PAR_IVDEP
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = src[i] > T(0) ? src[i] : slope * src[i];
+        }
+
+        template <class T>
+        static void backward(const T* out, T* err, const size_t count) noexcept
+        {
+            constexpr T slope = slope_v<T>;
+            PAR_IVDEP
+            for (size_t i = 0; i < count; ++i)
+                err[i] *= out[i] > T(0) ? T(1) : slope;
+        }
+
+        //negative values cannot be restored by ReLU (slope 0), they stay 0
+        template <vmath::accuracy, class T>
+        static void inverse(const T* src, T* dst, const size_t count) noexcept
+        {
+            constexpr T slope = slope_v<T>;
+            PAR_IVDEP
+            for (size_t i = 0; i < count; ++i)
+            {
+                if constexpr (Slope::num == 0)
+                    dst[i] = src[i] > T(0) ? src[i] : T(0);
+                else
+                    dst[i] = src[i] > T(0) ? src[i] : src[i] / slope;
+            }
+        }
+    private:
+        static_assert(Slope::num >= 0 && Slope::num < Slope::den, "Slope is expected in [0; 1).");
+
+        template <class T>
+        static constexpr T slope_v = static_cast<T>(Slope::num) / static_cast<T>(Slope::den);
+    };
+
+    using relu = leaky_relu<std::ratio<0>>;
+}
@@ -6,8 +6,17 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
 #include "cm_ctors.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 //warning, this is super-simple parser which does not handle quatter, embedded comas etc
 namespace csv
 {
@@ -49,7 +58,7 @@ namespace csv
         std::vector<int> m_data;
     };
 
-    std::istream& operator>>(std::istream& str, row& data)
+    inline std::istream& operator>>(std::istream& str, row& data)
     {
         data.readNextRow(str);
         return str;
@@ -142,4 +151,270 @@ namespace csv
             return iterator{};
         }
     };
+
+    ///thrown by int readers for field which is not a decimal int (after trimming spaces and '\r'),
+    ///row is 1-based number of not blank line, field is 0-based
+    class parse_error : public std::runtime_error
+    {
+    public:
+        parse_error(const size_t row, const size_t field, const std::string_view text) :
+            std::runtime_error("Malformed csv field " + std::to_string(field) + " of row " + std::to_string(row)
+                               + ": '" + std::string(text) + "'"),
+            row(row),
+            field(field)
+        {
+        }
+
+        const size_t row;
+        const size_t field;
+    };
+
+    namespace details
+    {
+        //bit i is set if p[i] == c, for i in [0, scan_width)
+#if defined(__AVX2__)
+        constexpr size_t scan_width = 32;
+        inline uint32_t match_mask(const char* p, const char c) noexcept
+        {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+        }
+#elif defined(__SSE2__)
+        constexpr size_t scan_width = 16;
+        inline uint32_t match_mask(const char* p, const char c) noexcept
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+        }
+#else
+        constexpr size_t scan_width = 8;
+        inline uint32_t match_mask(const char* p, const char c) noexcept
+        {
+            uint32_t m = 0;
+            for (size_t i = 0; i < scan_width; ++i)
+                m |= static_cast<uint32_t>(p[i] == c) << i;
+            return m;
+        }
+#endif
+
+        //the same as match_mask(), but reads n < scan_width chars only
+        inline uint32_t match_mask(const char* p, const char c, const size_t n) noexcept
+        {
+            uint32_t m = 0;
+            for (size_t i = 0; i < n; ++i)
+                m |= static_cast<uint32_t>(p[i] == c) << i;
+            return m;
+        }
+
+        inline bool is_space(const char c) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        //integer out of [from, to), spaces around it are skipped; false if there is anything else
+        //or value does not fit into int
+        inline bool parse_int(const char* from, const char* to, int& value) noexcept
+        {
+            for (; from < to && is_space(*from); ++from);
+            for (; to > from && is_space(to[-1]); --to);
+            const auto r = std::from_chars(from, to, value);
+            return from != to && r.ec == std::errc() && r.ptr == to;
+        }
+
+        //line [from, to) (without '\n') has no data
+        inline bool is_blank(const char* from, const char* to) noexcept
+        {
+            return from == to || (to - from == 1 && *from == '\r');
+        }
+
+        //calls field(index, value) for each comma separated field of line [from, to),
+        //chars up to limit >= to may be read by vector loads; row is used by parse_error only
+        template <class F>
+        size_t parse_line(const char* from, const char* to, const char* limit, const size_t row, F&& field)
+        {
+            size_t index = 0;
+            const char* start = from;
+            const auto parse = [&](const char* end)
+            {
+                int v;
+                if (!parse_int(start, end, v))
+                    throw parse_error(row, index, std::string_view(start, static_cast<size_t>(end - start)));
+                field(index++, v);
+            };
+            for (const char* p = from; p < to; p += scan_width)
+            {
+                const auto left = static_cast<size_t>(to - p);
+                uint32_t mask;
+                if (static_cast<size_t>(limit - p) >= scan_width)
+                {
+                    mask = match_mask(p, ',');
+                    if (left < scan_width)
+                        mask &= (uint32_t{1} << left) - 1;
+                }
+                else
+                    mask = match_mask(p, ',', left);
+
+                for (; mask; mask &= mask - 1)
+                {
+                    const char* comma = p + __builtin_ctz(mask);
+                    parse(comma);
+                    start = comma + 1;
+                }
+            }
+            parse(to);
+            return index;
+        }
+    }
+
+    ///number of lines in the rest of stream (the last one may have no line end), stream is left at the end
+    inline size_t count_lines(std::istream& str)
+    {
+        std::vector<char> block(1 << 20);
+        size_t lines = 0;
+        char last = '\n';
+        while (str)
+        {
+            str.read(block.data(), static_cast<std::streamsize>(block.size()));
+            const auto got = static_cast<size_t>(str.gcount());
+            if (!got)
+                break;
+            lines += static_cast<size_t>(std::count(block.data(), block.data() + got, '\n'));
+            last = block[got - 1];
+        }
+        return lines + (last != '\n');
+    }
+
+    ///block-based reader of csv with integer fields only (same limitations as row: no quotes etc).
+    ///Stream is read by big blocks, line end is found by memchr, commas by SIMD compare of the whole
+    ///vector of chars, each field is parsed in place and passed to the callback, so nothing
+    ///is allocated per row.
+    class int_reader
+    {
+    public:
+        explicit int_reader(std::istream& str, const size_t block_size = 1 << 20) :
+            stream(str),
+            block(block_size + details::scan_width)
+        {
+        }
+
+        NO_COPYMOVE(int_reader);
+        ~int_reader() = default;
+
+        ///parses next non-empty line and calls field(index, value) for each field in order,
+        ///returns amount of fields or 0 when stream ended. Throws parse_error for malformed field.
+        template <class F>
+        size_t next_row(F&& field)
+        {
+            const char* line_end;
+            while ((line_end = next_line()))
+            {
+                const char* from = block.data() + pos;
+                pos = static_cast<size_t>(line_end - block.data()) + 1;
+                if (!details::is_blank(from, line_end))
+                    return details::parse_line(from, line_end, block.data() + block.size(), ++rows, field);
+            }
+            return 0;
+        }
+    private:
+        std::istream& stream;
+        size_t rows{0};
+        //data is [pos, filled), there are always scan_width bytes after filled, so SIMD loads
+        //of the last chars do not go out of the buffer
+        std::vector<char> block;
+        size_t pos{0};
+        size_t filled{0};
+        bool eof{false};
+
+        //end of the line which starts at pos, reads more data if needed; nullptr if nothing left
+        const char* next_line()
+        {
+            for (size_t scanned = pos;;)
+            {
+                const auto nl = static_cast<const char*>(std::memchr(block.data() + scanned, '\n', filled - scanned));
+                if (nl)
+                    return nl;
+                if (eof)
+                {
+                    if (pos == filled)
+                        return nullptr;
+                    //the last line without line end, virtual one is put after it
+                    block[filled] = '\n';
+                    return block.data() + filled++;
+                }
+                scanned = filled - pos;
+                refill();
+            }
+        }
+
+        //moves unprocessed tail to the beginning and appends next block from stream
+        void refill()
+        {
+            const size_t tail = filled - pos;
+            std::memmove(block.data(), block.data() + pos, tail);
+            pos    = 0;
+            filled = tail;
+
+            const size_t capacity = block.size() - details::scan_width;
+            if (filled == capacity)
+                block.resize(block.size() * 2);
+
+            stream.read(block.data() + filled, static_cast<std::streamsize>(block.size() - details::scan_width - filled));
+            const auto got = static_cast<size_t>(stream.gcount());
+            filled += got;
+            eof = !got;
+        }
+    };
+
+    ///the same as int_reader, but over csv text which is already in memory (for example mapped file),
+    ///reads never go outside of [from, to). first_row is amount of rows before from (for parse_error)
+    class int_memory_reader
+    {
+    public:
+        int_memory_reader(const char* from, const char* to, const size_t first_row = 0) noexcept :
+            pos(from),
+            end(to),
+            rows(first_row)
+        {
+        }
+
+        DEFAULT_COPYMOVE(int_memory_reader);
+        ~int_memory_reader() = default;
+
+        template <class F>
+        size_t next_row(F&& field)
+        {
+            while (pos < end)
+            {
+                const char* from = pos;
+                const char* line_end = next_line_end(from);
+                pos = line_end == end ? end : line_end + 1;
+                if (!details::is_blank(from, line_end))
+                    return details::parse_line(from, line_end, end, ++rows, field);
+            }
+            return 0;
+        }
+
+        ///amount of not blank lines in the rest of data, rows which next_row() will return
+        size_t count_rows() const noexcept
+        {
+            size_t rows = 0;
+            for (const char* p = pos; p < end;)
+            {
+                const char* line_end = next_line_end(p);
+                rows += !details::is_blank(p, line_end);
+                p = line_end == end ? end : line_end + 1;
+            }
+            return rows;
+        }
+    private:
+        const char* pos;
+        const char* end;
+        size_t rows;
+
+        const char* next_line_end(const char* from) const noexcept
+        {
+            const auto nl = static_cast<const char*>(std::memchr(from, '\n', static_cast<size_t>(end - from)));
+            return nl ? nl : end;
+        }
+    };
 }
@@ -0,0 +1,443 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include "palign.h"
+#include "parallel.h"
+#include "simd.h"
+#include "half.h"
+
+//cache-blocked matrix products (BLIS-like scheme):
+//MC x KC block of A is packed into L2, KC x NR panel of B is packed into L1,
+//then register-blocked MR x NR micro kernel runs over packed data.
+//All matrices are addressed by (row stride, column stride), so transposed operands
+//are just swapped strides and never materialized.
+namespace gemm
+{
+    template <class Tp>
+    struct blocking
+    {
+        using pack_t = simd::pack<Tp>;
+#if defined(__AVX512F__)
+        //32 zmm registers: 16 accumulators + 2 B vectors + broadcast
+        static constexpr size_t MR = 8;
+#elif defined(__AVX2__)
+        //16 ymm registers: 12 accumulators + 2 B vectors + broadcast
+        static constexpr size_t MR = 6;
+#else
+        static constexpr size_t MR = 4;
+#endif
+        //vectors per row of the micro tile
+        static constexpr size_t NV = (pack_t::width > 1) ? 2 : 4;
+        static constexpr size_t NR = NV * pack_t::width;
+
+        //784x200 / 200x200 / 200x10 layers: 256 depth keeps B panel (256 x NR) in L1,
+        //MC rows split 200 rows layer into few parallel blocks
+        static constexpr size_t KC = 256;
+        static constexpr size_t MC = 8 * MR;
+        static constexpr size_t NC = 4096;
+
+        //products with less multiplications run on calling thread, can be overridden by GEMM_PAR_MIN_WORK
+#ifdef GEMM_PAR_MIN_WORK
+        static constexpr size_t par_min_work = GEMM_PAR_MIN_WORK;
+#else
+        static constexpr size_t par_min_work = size_t{1} << 18;
+#endif
+    };
+
+    namespace details
+    {
+        template <class Tp>
+        using buffer_t = std::vector<Tp, AlignedAllocator<Tp, prefFloatsAlign()>>;
+
+        //per thread packing buffers, allocated once and reused by all following calls
+        template <class Tp, int Which>
+        inline Tp* pack_buffer(const size_t size)
+        {
+            static thread_local buffer_t<Tp> buf;
+            if (buf.size() < size)
+                buf.resize(size);
+            return buf.data();
+        }
+
+        //A block (mc x kc) into row panels of MR, each panel stored k-major, zero padded
+        template <class Tp, size_t MR>
+        inline void pack_a(const size_t mc, const size_t kc, const Tp* a, const size_t rsa, const size_t csa, Tp* dst) noexcept
+        {
+            for (size_t ir = 0; ir < mc; ir += MR)
+            {
+                const size_t m = std::min(MR, mc - ir);
+                for (size_t k = 0; k < kc; ++k)
+                {
+                    const Tp* src = a + ir * rsa + k * csa;
+                    for (size_t i = 0; i < m; ++i)
+                        *dst++ = src[i * rsa];
+                    for (size_t i = m; i < MR; ++i)
+                        *dst++ = Tp(0);
+                }
+            }
+        }
+
+        //B block (kc x nc) into column panels of NR, each panel stored k-major, zero padded
+        template <class Tp, size_t NR>
+        inline void pack_b(const size_t kc, const size_t nc, const Tp* b, const size_t rsb, const size_t csb, Tp* dst) noexcept
+        {
+            for (size_t jr = 0; jr < nc; jr += NR)
+            {
+                const size_t n = std::min(NR, nc - jr);
+                for (size_t k = 0; k < kc; ++k)
+                {
+                    const Tp* src = b + k * rsb + jr * csb;
+                    for (size_t j = 0; j < n; ++j)
+                        *dst++ = src[j * csb];
+                    for (size_t j = n; j < NR; ++j)
+                        *dst++ = Tp(0);
+                }
+            }
+        }
+
+        //C(m x n) = alpha * packedA * packedB + beta * C, m <= MR, n <= NR
+        template <class Tp, size_t MR, size_t NV>
+        inline void micro_kernel(const size_t kc, const Tp* pa, const Tp* pb, Tp* c, const size_t rsc,
+                                 const Tp alpha, const Tp beta, const size_t m, const size_t n) noexcept
+        {
+            using V = simd::pack<Tp>;
+            constexpr size_t W  = V::width;
+            constexpr size_t NR = NV * W;
+
+            V acc[MR][NV];
+#pragma GCC unroll 16
+            for (size_t i = 0; i < MR; ++i)
+#pragma GCC unroll 16
+                for (size_t j = 0; j < NV; ++j)
+                    acc[i][j] = V::zero();
+
+            for (size_t k = 0; k < kc; ++k, pa += MR, pb += NR)
+            {
+                V b[NV];
+#pragma GCC unroll 16
+                for (size_t j = 0; j < NV; ++j)
+                    b[j] = V::load(pb + j * W);
+#pragma GCC unroll 16
+                for (size_t i = 0; i < MR; ++i)
+                {
+                    const V a = V::set1(pa[i]);
+#pragma GCC unroll 16
+                    for (size_t j = 0; j < NV; ++j)
+                        acc[i][j] = fma(a, b[j], acc[i][j]);
+                }
+            }
+
+            const V va = V::set1(alpha);
+            if (m == MR && n == NR)
+            {
+                const bool use_beta = beta != Tp(0);
+                const V vb = V::set1(beta);
+#pragma GCC unroll 16
+                for (size_t i = 0; i < MR; ++i)
+#pragma GCC unroll 16
+                    for (size_t j = 0; j < NV; ++j)
+                    {
+                        Tp* dst = c + i * rsc + j * W;
+                        const V r = acc[i][j] * va;
+                        (use_beta ? fma(V::loadu(dst), vb, r) : r).storeu(dst);
+                    }
+                return;
+            }
+
+            //edge tile
+            alignas(prefFloatsAlign()) Tp tmp[MR * NR];
+            for (size_t i = 0; i < MR; ++i)
+                for (size_t j = 0; j < NV; ++j)
+                    (acc[i][j] * va).store(tmp + i * NR + j * W);
+
+            for (size_t i = 0; i < m; ++i)
+                for (size_t j = 0; j < n; ++j)
+                {
+                    Tp& dst = c[i * rsc + j];
+                    dst = (beta != Tp(0)) ? tmp[i * NR + j] + beta * dst : tmp[i * NR + j];
+                }
+        }
+    }
+
+    ///allocates packing buffer of row blocks for calling thread, row blocks run on any thread of parallel backend,
+    ///so par::each_thread(reserve_buffers<Tp>) makes all later products of the threads allocation free.
+    ///Panel of B is packed by thread which calls gemm(), its buffer is allocated by the first product there
+    template <class Tp>
+    void reserve_buffers()
+    {
+        using bl = blocking<Tp>;
+        (void)details::pack_buffer<Tp, 0>(bl::MC * bl::KC);
+    }
+
+    ///C(M x N) = alpha * A(M x K) * B(K x N) + beta * C, C is row major with row stride rsc.
+    ///If beta is 0, C is not read.
+    ///Not inlined: sizes are runtime anyway, and inlining into every shape only bloats code
+    ///(and makes GCC warn about edge branches which never run for given shape).
+    template <class Tp>
+    [[gnu::noinline]] void gemm(const size_t M, const size_t N, const size_t K, const Tp alpha,
+              const Tp* a, const size_t rsa, const size_t csa,
+              const Tp* b, const size_t rsb, const size_t csb,
+              const Tp beta, Tp* c, const size_t rsc)
+    {
+        using bl = blocking<Tp>;
+        constexpr size_t MR = bl::MR;
+        constexpr size_t NR = bl::NR;
+
+        if (K == 0)
+        {
+            for (size_t i = 0; i < M; ++i)
+                for (size_t j = 0; j < N; ++j)
+                    c[i * rsc + j] = (beta != Tp(0)) ? beta * c[i * rsc + j] : Tp(0);
+            return;
+        }
+
+        const size_t mblocks = (M + bl::MC - 1) / bl::MC;
+        //do not wake up threads for tiny products
+        const bool parallel = mblocks > 1 && M * N * K >= bl::par_min_work;
+
+        for (size_t jc = 0; jc < N; jc += bl::NC)
+        {
+            const size_t nc = std::min(bl::NC, N - jc);
+            for (size_t pc = 0; pc < K; pc += bl::KC)
+            {
+                const size_t kc = std::min(bl::KC, K - pc);
+                const Tp beta_eff = (pc == 0) ? beta : Tp(1);
+
+                //B panel is packed once by calling thread and shared by all row blocks
+                Tp* pb = details::pack_buffer<Tp, 1>(bl::KC * ((nc + NR - 1) / NR) * NR);
+                details::pack_b<Tp, NR>(kc, nc, b + pc * rsb + jc * csb, rsb, csb, pb);
+
+                const auto block = [&](const size_t blk)
+                {
+                    const size_t ic = blk * bl::MC;
+                    const size_t mc = std::min(bl::MC, M - ic);
+                    Tp* pa = details::pack_buffer<Tp, 0>(bl::MC * bl::KC);
+                    details::pack_a<Tp, MR>(mc, kc, a + ic * rsa + pc * csa, rsa, csa, pa);
+
+                    for (size_t jr = 0; jr < nc; jr += NR)
+                        for (size_t ir = 0; ir < mc; ir += MR)
+                            details::micro_kernel<Tp, MR, bl::NV>(kc, pa + ir * kc, pb + jr * kc,
+                                                                 c + (ic + ir) * rsc + jc + jr, rsc, alpha, beta_eff,
+                                                                 std::min(MR, mc - ir), std::min(NR, nc - jr));
+                };
+
+                par::for_chunks(mblocks, parallel ? 1 : mblocks, [&block](const size_t from, const size_t to)
+                {
+                    for (size_t blk = from; blk < to; ++blk)
+                        block(blk);
+                });
+            }
+        }
+    }
+
+    namespace details
+    {
+        //vector of Tp out of A elements, which may be stored as 16 bit floats (see half.h)
+        template <class Tp, class Ta>
+        inline simd::pack<Tp> loadu_as(const Ta* p) noexcept
+        {
+            if constexpr (std::is_same<Ta, Tp>::value)
+                return simd::pack<Tp>::loadu(p);
+            else
+            {
+                static_assert(std::is_same<Tp, float>::value && fp::is_half_v<Ta>, "Only float math over 16 bit storage.");
+                return fp::loadu(p);
+            }
+        }
+    }
+
+    ///y(M) = alpha * A(M x K) * x(K) + beta * y, A is row major with row stride lda.
+    ///A may be stored as bf16/f16 (Ta), it is converted in registers and accumulated in Tp.
+    ///If beta is 0, y is not read.
+    template <class Tp, class Ta>
+    [[gnu::noinline]] void gemv(const size_t M, const size_t K, const Tp alpha, const Ta* a, const size_t lda,
+              const Tp* x, const Tp beta, Tp* y)
+    {
+        using V = simd::pack<Tp>;
+        constexpr size_t W  = V::width;
+        //rows per step, each row keeps own accumulator, x vector is loaded once per step
+        constexpr size_t RB = 4;
+
+        const auto store = [&](const size_t r, const Tp sum)
+        {
+            y[r] = (beta != Tp(0)) ? alpha * sum + beta * y[r] : alpha * sum;
+        };
+
+        //vectorized part of the row, the rest is done by scalar tail
+        const size_t kv = K / W * W;
+
+        const auto rows_block = [&](const size_t r0)
+        {
+            const size_t rcount = std::min(RB, M - r0);
+            if (rcount == RB)
+            {
+                V acc[RB];
+                for (auto& v : acc)
+                    v = V::zero();
+                for (size_t k = 0; k < kv; k += W)
+                {
+                    const V xv = V::loadu(x + k);
+#pragma GCC unroll 4
+                    for (size_t i = 0; i < RB; ++i)
+                        acc[i] = fma(details::loadu_as<Tp>(a + (r0 + i) * lda + k), xv, acc[i]);
+                }
+                for (size_t i = 0; i < RB; ++i)
+                {
+                    Tp sum = acc[i].reduce_add();
+                    for (size_t k = kv; k < K; ++k)
+                        sum += static_cast<Tp>(a[(r0 + i) * lda + k]) * x[k];
+                    store(r0 + i, sum);
+                }
+                return;
+            }
+
+            for (size_t r = r0; r < r0 + rcount; ++r)
+            {
+                V acc = V::zero();
+                for (size_t k = 0; k < kv; k += W)
+                    acc = fma(details::loadu_as<Tp>(a + r * lda + k), V::loadu(x + k), acc);
+                Tp sum = acc.reduce_add();
+                for (size_t k = kv; k < K; ++k)
+                    sum += static_cast<Tp>(a[r * lda + k]) * x[k];
+                store(r, sum);
+            }
+        };
+
+        //rows are split into chunks, so threads have reasonable amount of work each
+        constexpr size_t chunk = 16 * RB;
+        const size_t chunks = (M + chunk - 1) / chunk;
+        const auto run_chunk = [&](const size_t ch)
+        {
+            const size_t end = std::min(M, (ch + 1) * chunk);
+            for (size_t r = ch * chunk; r < end; r += RB)
+                rows_block(r);
+        };
+
+        const bool parallel = M * K >= blocking<Tp>::par_min_work;
+        par::for_chunks(chunks, parallel ? 1 : chunks, [&run_chunk](const size_t from, const size_t to)
+        {
+            for (size_t ch = from; ch < to; ++ch)
+                run_chunk(ch);
+        });
+    }
+
+    ///y(N) = alpha * A(M x N)^T * x(M) + beta * y, A is row major with row stride lda.
+    ///A is streamed by rows (no transposed copy), each row adds alpha * x[r] * A[r, :] into y.
+    ///A may be stored as bf16/f16 (Ta) as for gemv(). If beta is 0, y is not read.
+    template <class Tp, class Ta>
+    [[gnu::noinline]] void gemv_t(const size_t M, const size_t N, const Tp alpha, const Ta* a, const size_t lda,
+                                  const Tp* x, const Tp beta, Tp* y)
+    {
+        using V = simd::pack<Tp>;
+        constexpr size_t W  = V::width;
+        //rows per step, y chunk is loaded/stored once per RB rows
+        constexpr size_t RB = 4;
+
+        //columns are split into chunks, each chunk of y is owned by 1 thread
+        const auto columns = [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; ++c)
+                y[c] = (beta != Tp(0)) ? beta * y[c] : Tp(0);
+
+            const size_t cv = c0 + (c1 - c0) / W * W;
+            size_t r = 0;
+            for (; r + RB <= M; r += RB)
+            {
+                V xs[RB];
+                for (size_t i = 0; i < RB; ++i)
+                    xs[i] = V::set1(alpha * x[r + i]);
+
+                for (size_t c = c0; c < cv; c += W)
+                {
+                    V acc = V::loadu(y + c);
+#pragma GCC unroll 4
+                    for (size_t i = 0; i < RB; ++i)
+                        acc = fma(xs[i], details::loadu_as<Tp>(a + (r + i) * lda + c), acc);
+                    acc.storeu(y + c);
+                }
+                for (size_t c = cv; c < c1; ++c)
+                    for (size_t i = 0; i < RB; ++i)
+                        y[c] += alpha * x[r + i] * static_cast<Tp>(a[(r + i) * lda + c]);
+            }
+
+            for (; r < M; ++r)
+            {
+                const V xs = V::set1(alpha * x[r]);
+                for (size_t c = c0; c < cv; c += W)
+                    fma(xs, details::loadu_as<Tp>(a + r * lda + c), V::loadu(y + c)).storeu(y + c);
+                for (size_t c = cv; c < c1; ++c)
+                    y[c] += alpha * x[r] * static_cast<Tp>(a[r * lda + c]);
+            }
+        };
+
+        const bool parallel = M * N >= blocking<Tp>::par_min_work;
+        //chunk is multiple of vector and cache line
+        const size_t grain = parallel ? std::max<size_t>(16 * W, 64) : N;
+        par::for_chunks(N, grain, columns);
+    }
+
+    ///A(M x N) += alpha * x(M) * y(N)^T, rank-1 update (GER), A is row major with row stride lda
+    template <class Tp>
+    [[gnu::noinline]] void ger(const size_t M, const size_t N, const Tp alpha, const Tp* x, const Tp* y,
+                               Tp* a, const size_t lda)
+    {
+        using V = simd::pack<Tp>;
+        constexpr size_t W  = V::width;
+        const size_t nv = N / W * W;
+
+        const auto rows = [&](const size_t r0, const size_t r1)
+        {
+            for (size_t r = r0; r < r1; ++r)
+            {
+                const Tp s   = alpha * x[r];
+                const V  xs  = V::set1(s);
+                Tp* row = a + r * lda;
+                for (size_t c = 0; c < nv; c += W)
+                    fma(xs, V::loadu(y + c), V::loadu(row + c)).storeu(row + c);
+                for (size_t c = nv; c < N; ++c)
+                    row[c] += s * y[c];
+            }
+        };
+
+        const bool parallel = M * N >= blocking<Tp>::par_min_work;
+        par::for_chunks(M, parallel ? 16 : M, rows);
+    }
+
+    ///ger() which also rounds updated A into its 16 bit copy (same layout), so both are changed in 1 pass
+    template <class Tp, class Ts>
+    [[gnu::noinline]] void ger(const size_t M, const size_t N, const Tp alpha, const Tp* x, const Tp* y,
+                               Tp* a, const size_t lda, Ts* copy)
+    {
+        static_assert(std::is_same<Tp, float>::value && fp::is_half_v<Ts>, "Only float math over 16 bit storage.");
+        using V = simd::pack<Tp>;
+        constexpr size_t W  = V::width;
+        const size_t nv = N / W * W;
+
+        const auto rows = [&](const size_t r0, const size_t r1)
+        {
+            for (size_t r = r0; r < r1; ++r)
+            {
+                const Tp s   = alpha * x[r];
+                const V  xs  = V::set1(s);
+                Tp* row = a + r * lda;
+                Ts* dst = copy + r * lda;
+                for (size_t c = 0; c < nv; c += W)
+                {
+                    const V v = fma(xs, V::loadu(y + c), V::loadu(row + c));
+                    v.storeu(row + c);
+                    fp::storeu(v, dst + c);
+                }
+                for (size_t c = nv; c < N; ++c)
+                {
+                    row[c] += s * y[c];
+                    dst[c] = Ts(row[c]);
+                }
+            }
+        };
+
+        const bool parallel = M * N >= blocking<Tp>::par_min_work;
+        par::for_chunks(M, parallel ? 16 : M, rows);
+    }
+}
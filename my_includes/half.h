@@ -0,0 +1,280 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
+
+//16 bit floating storage types. Values are only stored in them: arithmetic is done in float,
+//loadu()/storeu() convert whole simd::pack<float> in registers (F16C / AVX-512 when available).
+// - bf16: upper half of float (8 bits exponent, 7 bits mantissa), the same range as float
+// - f16:  IEEE half (5 bits exponent, 10 bits mantissa), range is +-65504
+//Conversion from float rounds to nearest even.
+namespace fp
+{
+    namespace details
+    {
+        inline uint32_t float_bits(const float f) noexcept
+        {
+            uint32_t b;
+            std::memcpy(&b, &f, sizeof(b));
+            return b;
+        }
+
+        inline float bits_float(const uint32_t b) noexcept
+        {
+            float f;
+            std::memcpy(&f, &b, sizeof(f));
+            return f;
+        }
+
+        inline uint16_t to_bf16(const float f) noexcept
+        {
+            const uint32_t b = float_bits(f);
+            //NaN stays quiet NaN, rounding could turn it into infinity
+            if ((b & 0x7fffffffu) > 0x7f800000u)
+                return static_cast<uint16_t>((b >> 16) | 0x40u);
+            return static_cast<uint16_t>((b + 0x7fffu + ((b >> 16) & 1u)) >> 16);
+        }
+
+        inline float from_bf16(const uint16_t h) noexcept
+        {
+            return bits_float(uint32_t{h} << 16);
+        }
+
+        inline uint16_t to_f16(const float f) noexcept
+        {
+#if defined(__F16C__)
+            return static_cast<uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+            uint32_t x = float_bits(f);
+            const uint32_t sign = (x >> 16) & 0x8000u;
+            x &= 0x7fffffffu;
+
+            if (x >= 0x7f800000u)
+                return static_cast<uint16_t>(sign | 0x7c00u | (x > 0x7f800000u ? 0x200u : 0u));
+            //65520 and above round to infinity
+            if (x >= 0x477ff000u)
+                return static_cast<uint16_t>(sign | 0x7c00u);
+
+            uint32_t r;
+            uint32_t rem;
+            uint32_t half;
+            if (x < 0x38800000u)
+            {
+                //below 2^-14 half is subnormal, 2^-25 and below round to 0
+                if (x <= 0x33000000u)
+                    return static_cast<uint16_t>(sign);
+                const uint32_t m     = (x & 0x7fffffu) | 0x800000u;
+                const uint32_t shift = 126u - (x >> 23);
+                r    = m >> shift;
+                rem  = m & ((1u << shift) - 1u);
+                half = 1u << (shift - 1u);
+            }
+            else
+            {
+                //exponent bias 127 -> 15, carry of rounding goes into exponent correctly
+                r    = (x - 0x38000000u) >> 13;
+                rem  = x & 0x1fffu;
+                half = 0x1000u;
+            }
+            if (rem > half || (rem == half && (r & 1u)))
+                ++r;
+            return static_cast<uint16_t>(sign | r);
+#endif
+        }
+
+        inline float from_f16(const uint16_t h) noexcept
+        {
+#if defined(__F16C__)
+            return _cvtsh_ss(h);
+#else
+            const uint32_t sign = uint32_t{h & 0x8000u} << 16;
+            const uint32_t e = (h >> 10) & 0x1fu;
+            const uint32_t m = h & 0x3ffu;
+
+            //NaN is made quiet as F16C does
+            if (e == 0x1f)
+                return bits_float(sign | 0x7f800000u | (m << 13) | (m ? 0x400000u : 0u));
+            if (e)
+                return bits_float(sign | ((e + 112u) << 23) | (m << 13));
+            //subnormal (or 0): m * 2^-24 is exact in float
+            const float v = static_cast<float>(m) * 5.9604644775390625e-8f;
+            return sign ? -v : v;
+#endif
+        }
+    }
+
+    struct bf16
+    {
+        uint16_t bits{0};
+
+        bf16() = default;
+
+        explicit bf16(const float f) noexcept :
+            bits(details::to_bf16(f))
+        {
+        }
+
+        operator float() const noexcept
+        {
+            return details::from_bf16(bits);
+        }
+    };
+
+    struct f16
+    {
+        uint16_t bits{0};
+
+        f16() = default;
+
+        explicit f16(const float f) noexcept :
+            bits(details::to_f16(f))
+        {
+        }
+
+        operator float() const noexcept
+        {
+            return details::from_f16(bits);
+        }
+    };
+
+    static_assert(sizeof(bf16) == 2 && sizeof(f16) == 2, "Storage types must be packed.");
+
+    template <class T>
+    constexpr bool is_half_v = std::is_same<T, bf16>::value || std::is_same<T, f16>::value;
+
+    using pack_t = simd::pack<float>;
+
+    //generic path: element by element through memory
+    template <class S>
+    inline pack_t loadu_scalar(const S* p) noexcept
+    {
+        float tmp[pack_t::width];
+        for (size_t i = 0; i < pack_t::width; ++i)
+            tmp[i] = static_cast<float>(p[i]);
+        return pack_t::loadu(tmp);
+    }
+
+    template <class S>
+    inline void storeu_scalar(const pack_t v, S* p) noexcept
+    {
+        float tmp[pack_t::width];
+        v.storeu(tmp);
+        for (size_t i = 0; i < pack_t::width; ++i)
+            p[i] = S(tmp[i]);
+    }
+
+#if defined(__AVX512F__)
+    //zero-masked forms avoid false -Wmaybe-uninitialized of GCC 12 (see simd::f32x16)
+    constexpr __mmask16 all = 0xffff;
+
+    ///pack_t::width values widened into float register
+    inline pack_t loadu(const bf16* p) noexcept
+    {
+        const __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        return {_mm512_castsi512_ps(_mm512_maskz_slli_epi32(all, _mm512_maskz_cvtepu16_epi32(all, h), 16))};
+    }
+
+    inline pack_t loadu(const f16* p) noexcept
+    {
+        return {_mm512_maskz_cvtph_ps(all, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)))};
+    }
+
+    ///float register rounded into pack_t::width values
+    inline void storeu(const pack_t v, bf16* p) noexcept
+    {
+        const __m512i b    = _mm512_castps_si512(v.v);
+        const __m512i high = _mm512_maskz_srli_epi32(all, b, 16);
+        const __m512i lsb  = _mm512_and_si512(high, _mm512_set1_epi32(1));
+        __m512i r = _mm512_maskz_srli_epi32(all, _mm512_add_epi32(b, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff))), 16);
+        const __mmask16 nan = _mm512_cmp_ps_mask(v.v, v.v, _CMP_UNORD_Q);
+        r = _mm512_mask_or_epi32(r, nan, high, _mm512_set1_epi32(0x40));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvtepi32_epi16(all, r));
+    }
+
+    inline void storeu(const pack_t v, f16* p) noexcept
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),
+                            _mm512_maskz_cvtps_ph(all, v.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    inline pack_t loadu(const bf16* p) noexcept
+    {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return {_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16))};
+    }
+
+    inline void storeu(const pack_t v, bf16* p) noexcept
+    {
+        const __m256i b   = _mm256_castps_si256(v.v);
+        const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(b, 16), _mm256_set1_epi32(1));
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(b, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))), 16);
+        const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v.v, v.v, _CMP_UNORD_Q));
+        r = _mm256_blendv_epi8(r, _mm256_or_si256(_mm256_srli_epi32(b, 16), _mm256_set1_epi32(0x40)), nan);
+        //packus works per 128 bits lane, qwords 0 and 2 keep all 8 values
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+    }
+
+#if defined(__F16C__)
+    inline pack_t loadu(const f16* p) noexcept
+    {
+        return {_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))};
+    }
+
+    inline void storeu(const pack_t v, f16* p) noexcept
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v.v, _MM_FROUND_TO_NEAREST_INT));
+    }
+#else
+    inline pack_t loadu(const f16* p) noexcept
+    {
+        return loadu_scalar(p);
+    }
+
+    inline void storeu(const pack_t v, f16* p) noexcept
+    {
+        storeu_scalar(v, p);
+    }
+#endif
+#else
+    template <class S, class = std::enable_if_t<is_half_v<S>>>
+    inline pack_t loadu(const S* p) noexcept
+    {
+        return loadu_scalar(p);
+    }
+
+    template <class S, class = std::enable_if_t<is_half_v<S>>>
+    inline void storeu(const pack_t v, S* p) noexcept
+    {
+        storeu_scalar(v, p);
+    }
+#endif
+
+    ///dst[i] = To(src[i]), one of the types is float and other one is storage type (or float too)
+    template <class From, class To>
+    inline void convert(const From* src, To* dst, const size_t count) noexcept
+    {
+        constexpr size_t W = pack_t::width;
+        const size_t body = count - count % W;
+        size_t i = 0;
+        if constexpr (std::is_same<From, float>::value && is_half_v<To>)
+        {
+            for (; i < body; i += W)
+                storeu(pack_t::loadu(src + i), dst + i);
+        }
+        if constexpr (is_half_v<From> && std::is_same<To, float>::value)
+        {
+            for (; i < body; i += W)
+                loadu(src + i).storeu(dst + i);
+        }
+        for (; i < count; ++i)
+            dst[i] = To(static_cast<float>(src[i]));
+    }
+}
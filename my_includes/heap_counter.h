@@ -0,0 +1,112 @@
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+//counters of all heap allocations of the program, made by replaced global operator new/delete.
+//Replacement must be defined in exactly 1 translation unit: define HEAP_COUNTER_IMPLEMENT before
+//including this header there. Without it counters stay 0 and installed() is false.
+struct HeapCounter
+{
+    static inline std::atomic<std::size_t> allocations{0};
+    static inline std::atomic<std::size_t> deallocations{0};
+
+    static bool installed() noexcept
+    {
+        return hooked.load(std::memory_order_relaxed);
+    }
+
+    //set by replaced operator new, so caller can tell that 0 allocations is measured, not missing hook
+    static inline std::atomic<bool> hooked{false};
+};
+
+#ifdef HEAP_COUNTER_IMPLEMENT
+namespace heap_counter_details
+{
+    inline void* allocate(std::size_t size, const std::size_t align)
+    {
+        HeapCounter::hooked.store(true, std::memory_order_relaxed);
+        HeapCounter::allocations.fetch_add(1, std::memory_order_relaxed);
+        if (!size)
+            size = 1;
+        void* p = nullptr;
+        if (align <= alignof(std::max_align_t))
+            p = std::malloc(size);
+        else
+            p = std::aligned_alloc(align, (size + align - 1) / align * align);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    inline void release(void* p) noexcept
+    {
+        if (!p)
+            return;
+        HeapCounter::deallocations.fetch_add(1, std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return heap_counter_details::allocate(size, 0);
+}
+
+void* operator new[](std::size_t size)
+{
+    return heap_counter_details::allocate(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return heap_counter_details::allocate(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return heap_counter_details::allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    heap_counter_details::release(p);
+}
+#endif
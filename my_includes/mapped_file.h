@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cm_ctors.h"
+
+namespace utility
+{
+    //read-only memory mapping of the whole file (POSIX), pages are loaded by OS on first access.
+    //Empty file is valid: nothing is mapped, data() is nullptr and size() is 0
+    class mapped_file
+    {
+    private:
+        const uint8_t* ptr{nullptr};
+        size_t length{0};
+    public:
+        explicit mapped_file(const std::string& file_name)
+        {
+            const int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open file: " + file_name);
+
+            struct stat st{};
+            if (::fstat(fd, &st) != 0 || st.st_size < 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Cannot read file: " + file_name);
+            }
+            length = static_cast<size_t>(st.st_size);
+            //mmap of 0 bytes fails
+            if (!length)
+            {
+                ::close(fd);
+                return;
+            }
+
+            void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            //mapping keeps file referenced, descriptor is not needed anymore
+            ::close(fd);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("Cannot map file: " + file_name);
+
+            ::madvise(p, length, MADV_WILLNEED);
+            ptr = static_cast<const uint8_t*>(p);
+        }
+
+        NO_COPYMOVE(mapped_file);
+
+        ~mapped_file()
+        {
+            if (ptr)
+                ::munmap(const_cast<uint8_t*>(ptr), length);
+        }
+
+        const uint8_t* data() const noexcept
+        {
+            return ptr;
+        }
+
+        size_t size() const noexcept
+        {
+            return length;
+        }
+    };
+}
@@ -3,14 +3,19 @@
 #include <numeric>
 #include <stdint.h>
 #include <array>
+#include <vector>
+#include <type_traits>
 #include <iostream>
 #include <algorithm>
-#include <execution>
+#include <cmath>
 #include <initializer_list>
 
 #include "cm_ctors.h"
 #include "cust_iters.h"
+#include "gemm.h"
+#include "matrix_expr.h"
 #include "palign.h"
+#include "parallel.h"
 #include "types_helpers.h"
 
 //destructive size allows different elements be separated for different threads
@@ -18,9 +23,29 @@
 
 #define MATRIX_ALIGN prefFloatsAlign()
 
+//matrices which take up to this amount of bytes keep data inside of the object (no heap),
+//bigger ones (like weights) are allocated on heap, can be overridden before include
+#ifndef MATRIX_INLINE_MAX_BYTES
+#define MATRIX_INLINE_MAX_BYTES 4096
+#endif
+
 template<typename T, std::size_t ALIGNMENT_IN_BYTES>
 using AlignedVector = std::vector<T, AlignedAllocator<T, ALIGNMENT_IN_BYTES> >;
 
+template<typename T, std::size_t Size, std::size_t ALIGNMENT_IN_BYTES>
+struct alignas(ALIGNMENT_IN_BYTES) AlignedArray : public std::array<T, Size>
+{
+    //same as AlignedVector::resize() of the new vector: size is fixed, just zeroing values
+    void resize(std::size_t)
+    {
+        this->fill(T(0));
+    }
+};
+
+template <typename Tp, size_t Rows, size_t Cols>
+using MatrixStorage = typename std::conditional<(Rows * Cols * sizeof(Tp) <= MATRIX_INLINE_MAX_BYTES),
+      AlignedArray<Tp, Rows * Cols, MATRIX_ALIGN>, AlignedVector<Tp, MATRIX_ALIGN>>::type;
+
 template <typename Tp, size_t Rows, size_t Cols>
 class Matrix2D;
 
@@ -36,11 +61,11 @@ class Matrix2D
 {
 private:
     static_assert(std::is_arithmetic<Tp>::value, "Only numbers are supported.");
-    AlignedVector<Tp, MATRIX_ALIGN> data;
+    MatrixStorage<Tp, Rows, Cols> values;
 
     void resize()
     {
-        data.resize(Cols * Rows);
+        values.resize(Cols * Rows);
     }
 
     static constexpr size_t index(const size_t r, const size_t c) noexcept
@@ -59,7 +84,7 @@ private:
             const auto &ref = src.begin()[r];
             if (ref.size() != Cols)
                 throw std::range_error("Wrong colss amount in initializer list.");
-            std::copy(std::execution::par_unseq, ref.begin(), ref.end(), begin() + index(r, 0));
+            std::copy(ref.begin(), ref.end(), begin() + index(r, 0));
         }
     }
 
@@ -70,7 +95,20 @@ private:
             throw std::range_error("Wrong size for vector in initializer list.");
 
         resize();
-        std::copy(std::execution::par_unseq, src.begin(), src.end(), data.begin());
+        std::copy(src.begin(), src.end(), values.begin());
+    }
+    //this[i] = op(this[i], e[i]) for all elements in 1 pass
+    template <class E, class Op>
+    void eval_into(const E& e, const Op op)
+    {
+        using et = mexpr::traits<E>;
+        static_assert(et::rows == 0 || (et::rows == Rows && et::cols == Cols),
+                      "Element-wise operations require the same sizes of the matrices.");
+        Tp* dst = data();
+        par::for_each_index<Rows * Cols>([&](const size_t i)
+        {
+            dst[i] = static_cast<Tp>(op(dst[i], mexpr::element(e, i)));
+        });
     }
 public:
 
@@ -79,6 +117,12 @@ public:
         return Rows == 1 || Cols == 1;
     }
 
+    ///true if data are stored inside of the object, see MATRIX_INLINE_MAX_BYTES
+    static constexpr bool is_inline() noexcept
+    {
+        return !std::is_same<MatrixStorage<Tp, Rows, Cols>, AlignedVector<Tp, MATRIX_ALIGN>>::value;
+    }
+
     constexpr auto rows() const noexcept
     {
         return Rows;
@@ -91,7 +135,17 @@ public:
 
     size_t size() const noexcept
     {
-        return data.size();
+        return values.size();
+    }
+
+    Tp* data() noexcept
+    {
+        return values.data();
+    }
+
+    const Tp* data() const noexcept
+    {
+        return values.data();
     }
 
     Matrix2D()
@@ -123,6 +177,20 @@ public:
         return *this;
     }
 
+    template <class E, class = std::enable_if_t<mexpr::is_expression_v<E>>>
+    Matrix2D(const E& e)
+    {
+        resize();
+        eval_into(e, mexpr::ops::assign{});
+    }
+
+    template <class E, class = std::enable_if_t<mexpr::is_expression_v<E>>>
+    auto& operator = (const E& e)
+    {
+        eval_into(e, mexpr::ops::assign{});
+        return *this;
+    }
+
     const Tp& at(const size_t r, const size_t c) const
 #ifdef NDEBUG
     noexcept
@@ -131,7 +199,7 @@ public:
 #ifdef NDEBUG
         return *(begin() + index(r,c));
 #else
-        return data.at(index(r, c));
+        return values.at(index(r, c));
 #endif
     }
 
@@ -143,7 +211,7 @@ public:
 #ifdef NDEBUG
         return *(begin() + index(r,c));
 #else
-        return data.at(index(r, c));
+        return values.at(index(r, c));
 #endif
     }
 
@@ -151,186 +219,120 @@ public:
     auto dot(const Matrix2D<Tp, Cols, cls> &by) const
     {
         Matrix2D<Tp, Rows, cls> res;
-        constexpr bool p1 = Rows > 1;
-        constexpr bool p2 = !p1 && cls > 1;
-
-        std::for_each(thelpers::seq_or_par<p1>::value(), IndexIter(0), IndexIter(Rows), [&](auto r)
-        {
-            std::for_each(thelpers::seq_or_par<p2>::value(), IndexIter(0), IndexIter(cls), [&](auto cres)
-            {
-                constexpr auto zero = static_cast<Tp>(0);
-                const auto beg = begin() + index (r, 0);
-                res.at(r, cres) = std::accumulate(IndexIter(0), IndexIter(Cols), zero, [&](const auto old, const auto k)
-                {
-                    return old + *(beg + k) * by.at(k, cres);
-                });
-            });
-        });
-        return res;
-    }
-
-    Matrix2D<Tp, Cols, Rows> transpose() const
-    {
-        Matrix2D<Tp, Cols, Rows> res;
-        for (size_t i = 0; i < Cols; ++i)
-            for (size_t j = 0; j < Rows; ++j)
-                res.at(i, j) = at(j, i);
+        dot(by, res);
         return res;
     }
 
-    void set_zero()
-    {
-        std::fill(std::execution::par_unseq, begin(), end(), Tp(0));
-    }
-
-    //element-to-element arithmetic of the same-sized matrices
-    auto& operator *=(const Matrix2D<Tp, Rows, Cols>& c)
-    {
-        std::for_each(std::execution::par_unseq, IndexIter(0), IndexIter(Rows * Cols), [&](auto i)
-        {
-            *(begin() + i) *= *(c.begin() + i);
-        });
-        return *this;
-    }
-
-    auto operator *(const Matrix2D<Tp, Rows, Cols>& c) const
-    {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res *= c;
-        return res;
-    }
-
-    auto& operator /=(const Matrix2D<Tp, Rows, Cols>& c)
-    {
-        std::for_each(std::execution::par_unseq, IndexIter(0), IndexIter(Rows * Cols), [&](auto i)
-        {
-            *(begin() + i) /= *(c.begin() + i);
-        });
-        return *this;
-    }
-
-    auto operator /(const Matrix2D<Tp, Rows, Cols>& c) const
-    {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res /= c;
-        return res;
-    }
-
-    auto& operator +=(const Matrix2D<Tp, Rows, Cols>& c)
+    ///same as above, but stores result into existing matrix (no allocations)
+    template <size_t cls>
+    void dot(const Matrix2D<Tp, Cols, cls> &by, Matrix2D<Tp, Rows, cls>& res) const
     {
-        std::for_each(std::execution::par_unseq, IndexIter(0), IndexIter(Rows * Cols), [&](auto i)
-        {
-            *(begin() + i) += *(c.begin() + i);
-        });
-        return *this;
+        if constexpr (cls == 1)
+            gemm::gemv(Rows, Cols, Tp(1), data(), Cols, by.data(), Tp(0), res.data());
+        else
+            gemm::gemm(Rows, cls, Cols, Tp(1), data(), Cols, 1, by.data(), cls, 1, Tp(0), res.data(), cls);
     }
 
-    auto operator +(const Matrix2D<Tp, Rows, Cols>& c) const
+    ///this^T * by, transposed matrix is not created
+    template <size_t cls>
+    auto tdot(const Matrix2D<Tp, Rows, cls> &by) const
     {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res += c;
+        Matrix2D<Tp, Cols, cls> res;
+        tdot(by, res);
         return res;
     }
 
-    auto& operator -=(const Matrix2D<Tp, Rows, Cols>& c)
-    {
-        std::for_each(std::execution::par_unseq, IndexIter(0), IndexIter(Rows * Cols), [&](auto i)
-        {
-            *(begin() + i) -= *(c.begin() + i);
-        });
-        return *this;
-    }
-
-    auto operator -(const Matrix2D<Tp, Rows, Cols>& c) const
+    template <size_t cls>
+    void tdot(const Matrix2D<Tp, Rows, cls> &by, Matrix2D<Tp, Cols, cls>& res) const
     {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res -= c;
-        return res;
+        if constexpr (cls == 1)
+            gemm::gemv_t(Rows, Cols, Tp(1), data(), Cols, by.data(), Tp(0), res.data());
+        else
+            gemm::gemm(Cols, cls, Rows, Tp(1), data(), 1, Cols, by.data(), cls, 1, Tp(0), res.data(), cls);
     }
 
-    //matrix by scalar arithmetics
-    auto& operator *=(const Tp v)
+    ///this += alpha * x * y^T in place. For vectors (N = 1) it is rank-1 update,
+    ///for N columns it is sum of N rank-1 updates (one per column pair).
+    template <size_t N>
+    auto& add_outer(const Tp alpha, const Matrix2D<Tp, Rows, N>& x, const Matrix2D<Tp, Cols, N>& y)
     {
-        std::transform(std::execution::par_unseq, begin(), end(), begin(), [&v](const auto n)
-        {
-            return n * v;
-        });
+        if constexpr (N == 1)
+            gemm::ger(Rows, Cols, alpha, x.data(), y.data(), data(), Cols);
+        else
+            gemm::gemm(Rows, Cols, N, alpha, x.data(), N, 1, y.data(), 1, N, Tp(1), data(), Cols);
         return *this;
     }
 
-    auto operator *(const Tp v) const
+    Matrix2D<Tp, Cols, Rows> transpose() const
     {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res *= v;
+        Matrix2D<Tp, Cols, Rows> res;
+        transpose(res);
         return res;
     }
 
-    auto& operator /=(const Tp v)
+    void transpose(Matrix2D<Tp, Cols, Rows>& res) const
     {
-        std::transform(std::execution::par_unseq, begin(), end(), begin(), [&v](const auto n)
-        {
-            return n / v;
-        });
-        return *this;
+        for (size_t i = 0; i < Cols; ++i)
+            for (size_t j = 0; j < Rows; ++j)
+                res.at(i, j) = at(j, i);
     }
 
-    auto operator /(const Tp v) const
+    void set_zero()
     {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res /= v;
-        return res;
+        std::fill(begin(), end(), Tp(0));
     }
 
-    auto& operator +=(const Tp v)
+    ///applies f to each element in place: this[i] = f(this[i])
+    template <class F>
+    auto& apply(F&& f)
     {
-        std::transform(std::execution::par_unseq, begin(), end(), begin(), [&v](const auto n)
+        Tp* dst = data();
+        par::for_each_index<Rows * Cols>([&](const size_t i)
         {
-            return n + v;
+            dst[i] = f(dst[i]);
         });
         return *this;
     }
 
-    auto operator +(const Tp v) const
-    {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res += v;
-        return res;
+    //element-to-element arithmetic of the same-sized matrices,
+    //right side can be matrix or lazy expression (see matrix_expr.h), which is evaluated in the same loop
+#define MATRIX_COMPOUND_OP(OPERATOR, OP) \
+    template <class E, class = std::enable_if_t<mexpr::is_operand_v<E>>> \
+    auto& operator OPERATOR (const E& e) \
+    { \
+        eval_into(e, mexpr::ops::OP{}); \
+        return *this; \
+    } \
+    auto& operator OPERATOR (const Tp v) \
+    { \
+        eval_into(mexpr::scalar<Tp>{v}, mexpr::ops::OP{}); \
+        return *this; \
     }
 
-    auto& operator -=(const Tp v)
-    {
-        std::transform(std::execution::par_unseq, begin(), end(), begin(), [&v](const auto n)
-        {
-            return n - v;
-        });
-        return *this;
-    }
-
-    auto operator -(const Tp v) const
-    {
-        Matrix2D<Tp, Rows, Cols> res(*this);
-        res -= v;
-        return res;
-    }
+    MATRIX_COMPOUND_OP(*=, mul)
+    MATRIX_COMPOUND_OP(/=, div)
+    MATRIX_COMPOUND_OP(+=, add)
+    MATRIX_COMPOUND_OP(-=, sub)
+#undef MATRIX_COMPOUND_OP
 
     auto begin() noexcept
     {
-        return data.begin();
+        return values.begin();
     }
 
     auto end() noexcept
     {
-        return data.end();
+        return values.end();
     }
 
     auto begin() const noexcept
     {
-        return data.cbegin();
+        return values.cbegin();
     }
 
     auto end() const noexcept
     {
-        return data.cend();
+        return values.cend();
     }
 
     template <class OS>
@@ -341,7 +343,7 @@ public:
         {
             s << " {";
             for(size_t c = 0; c < cols(); ++c)
-                s << data[index(r,c)] << ",";
+                s << values[index(r,c)] << ",";
             s << " }," << std::endl;
         }
         s << "}" << std::endl;
@@ -403,18 +405,92 @@ namespace mtest
         */
         return a.dot(b);
     }
-}
 
-///allows to do like 1 - matrix
-template <class Float, size_t Rows, size_t Cols>
-inline Matrix2D<Float, Rows, Cols> operator - (const Float v, Matrix2D<Float, Rows, Cols> src)
-{
-    std::transform(std::execution::par_unseq, std::begin(src), std::end(src), std::begin(src),
-                   [&v](const Float x)
+    //deterministic values in [-1; 1) which are not all the same
+    template <class Matrix>
+    inline void fill_pattern(Matrix& m, const size_t seed)
+    {
+        for (size_t i = 0; i < m.size(); ++i)
+            m.data()[i] = static_cast<float>((i * 7919 + seed * 104729) % 2001) / 1000.f - 1.f;
+    }
+
+    //max difference of dot, tdot and add_outer of R x C matrix (N columns on the other side) from naive loops
+    //accumulated in double, relative to sum of abs. values of products (float rounding grows with it)
+    template <size_t R, size_t C, size_t N>
+    inline double kernels_error()
     {
-        return v - x;
-    });
-    return src;
+        Matrix2D<float, R, C> a;
+        Matrix2D<float, C, N> x;
+        Matrix2D<float, R, N> y;
+        fill_pattern(a, 1);
+        fill_pattern(x, 2);
+        fill_pattern(y, 3);
+
+        double err = 0;
+        double scale = 0;
+        const auto check = [&err, &scale](const double expected, const float got)
+        {
+            err = std::max(err, std::abs(expected - static_cast<double>(got)) / std::max(1., scale));
+        };
+
+        //a * x
+        const auto d = a.dot(x);
+        for (size_t i = 0; i < R; ++i)
+            for (size_t j = 0; j < N; ++j)
+            {
+                double sum = 0;
+                scale = 0;
+                for (size_t k = 0; k < C; ++k)
+                {
+                    sum += static_cast<double>(a.at(i, k)) * x.at(k, j);
+                    scale += std::abs(static_cast<double>(a.at(i, k)) * x.at(k, j));
+                }
+                check(sum, d.at(i, j));
+            }
+
+        //a^T * y
+        const auto t = a.tdot(y);
+        for (size_t i = 0; i < C; ++i)
+            for (size_t j = 0; j < N; ++j)
+            {
+                double sum = 0;
+                scale = 0;
+                for (size_t k = 0; k < R; ++k)
+                {
+                    sum += static_cast<double>(a.at(k, i)) * y.at(k, j);
+                    scale += std::abs(static_cast<double>(a.at(k, i)) * y.at(k, j));
+                }
+                check(sum, t.at(i, j));
+            }
+
+        //a + 0.5 * y * x^T
+        auto o = a;
+        o.add_outer(0.5f, y, x);
+        for (size_t i = 0; i < R; ++i)
+            for (size_t j = 0; j < C; ++j)
+            {
+                double sum = 0;
+                scale = 0;
+                for (size_t k = 0; k < N; ++k)
+                {
+                    sum += static_cast<double>(y.at(i, k)) * x.at(j, k);
+                    scale += std::abs(0.5 * y.at(i, k) * x.at(j, k));
+                }
+                check(a.at(i, j) + 0.5 * sum, o.at(i, j));
+            }
+        return err;
+    }
+
+    //GEMM/GEMV/GER kernels against naive loops: remainders of MR/NR blocks (37x13), depth over KC (300 > 256),
+    //columns over NC (4100 > 4096), vectors (N = 1)
+    /*
+    Expecting result: less than 1e-6
+    */
+    inline double test_kernels()
+    {
+        return std::max({kernels_error<37, 13, 1>(), kernels_error<37, 13, 5>(), kernels_error<37, 300, 13>(),
+                         kernels_error<300, 37, 13>(), kernels_error<5, 7, 4100>(), kernels_error<200, 784, 32>()});
+    }
 }
 
 #undef MATRIX_ALIGN
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+
+#include <cereal/cereal.hpp>
+
+#include "matrix2d.h"
+
+//cereal support of Matrix2D, include it together with the archives needed.
+//Sizes are stored before values and checked on load, because Matrix2D cannot be resized.
+//Binary archives get values as 1 block (portable one swaps bytes per element if needed),
+//text archives (JSON, XML) get them 1 by 1.
+namespace matrix_cereal
+{
+    template <class Archive, class Tp>
+    constexpr bool is_block_output_v = cereal::traits::is_output_serializable<cereal::BinaryData<const Tp*>, Archive>::value;
+
+    template <class Archive, class Tp>
+    constexpr bool is_block_input_v = cereal::traits::is_input_serializable<cereal::BinaryData<Tp*>, Archive>::value;
+}
+
+template <class Archive, typename Tp, size_t Rows, size_t Cols>
+void save(Archive& ar, const Matrix2D<Tp, Rows, Cols>& m)
+{
+    //sizes are fixed width, so file does not depend on size_t of the platform
+    const uint64_t rows = Rows;
+    const uint64_t cols = Cols;
+    ar(cereal::make_nvp("rows", rows), cereal::make_nvp("cols", cols));
+
+    if constexpr (matrix_cereal::is_block_output_v<Archive, Tp>)
+        ar(cereal::binary_data(m.data(), sizeof(Tp) * m.size()));
+    else
+        for (size_t i = 0; i < m.size(); ++i)
+            ar(m.data()[i]);
+}
+
+template <class Archive, typename Tp, size_t Rows, size_t Cols>
+void load(Archive& ar, Matrix2D<Tp, Rows, Cols>& m)
+{
+    uint64_t rows = 0;
+    uint64_t cols = 0;
+    ar(cereal::make_nvp("rows", rows), cereal::make_nvp("cols", cols));
+    if (rows != Rows || cols != Cols)
+        throw std::runtime_error("Matrix size mismatch on load: stored " + std::to_string(rows) + "x" + std::to_string(cols)
+                                 + ", expected " + std::to_string(Rows) + "x" + std::to_string(Cols));
+
+    if constexpr (matrix_cereal::is_block_input_v<Archive, Tp>)
+        ar(cereal::binary_data(m.data(), sizeof(Tp) * m.size()));
+    else
+        for (size_t i = 0; i < m.size(); ++i)
+            ar(m.data()[i]);
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+template <typename Tp, size_t Rows, size_t Cols>
+class Matrix2D;
+
+//lazy element-wise arithmetic for Matrix2D:
+//operators build expression tree, which is evaluated by single loop when assigned into matrix,
+//so chains like err * o * (1 - o) do not create temporaries
+namespace mexpr
+{
+    namespace ops
+    {
+        struct add
+        {
+            template <class A, class B>
+            auto operator()(const A a, const B b) const noexcept
+            {
+                return a + b;
+            }
+        };
+
+        struct sub
+        {
+            template <class A, class B>
+            auto operator()(const A a, const B b) const noexcept
+            {
+                return a - b;
+            }
+        };
+
+        struct mul
+        {
+            template <class A, class B>
+            auto operator()(const A a, const B b) const noexcept
+            {
+                return a * b;
+            }
+        };
+
+        struct div
+        {
+            template <class A, class B>
+            auto operator()(const A a, const B b) const noexcept
+            {
+                return a / b;
+            }
+        };
+
+        //plain assignment of the right side, used by evaluation into matrix
+        struct assign
+        {
+            template <class A, class B>
+            auto operator()(const A, const B b) const noexcept
+            {
+                return b;
+            }
+        };
+    }
+
+    //scalar taking part in expression, it has no size and is broadcasted to all elements
+    template <class Tp>
+    struct scalar
+    {
+        Tp v;
+    };
+
+    template <class Op, class L, class R>
+    class binary;
+
+    //describes anything which can be operand of expression,
+    //rows/cols are 0 for scalars
+    template <class T>
+    struct traits
+    {
+        static constexpr bool is_operand    = false;
+        static constexpr bool is_expression = false;
+    };
+
+    template <class Tp, size_t R, size_t C>
+    struct traits<Matrix2D<Tp, R, C>>
+    {
+        static constexpr bool is_operand    = true;
+        static constexpr bool is_expression = false;
+        using value_type = Tp;
+        static constexpr size_t rows = R;
+        static constexpr size_t cols = C;
+
+        static Tp element(const Matrix2D<Tp, R, C>& m, const size_t i) noexcept
+        {
+            return m.data()[i];
+        }
+    };
+
+    template <class Tp>
+    struct traits<scalar<Tp>>
+    {
+        static constexpr bool is_operand    = false;
+        static constexpr bool is_expression = false;
+        using value_type = Tp;
+        static constexpr size_t rows = 0;
+        static constexpr size_t cols = 0;
+
+        static Tp element(const scalar<Tp>& s, const size_t) noexcept
+        {
+            return s.v;
+        }
+    };
+
+    template <class Op, class L, class R>
+    struct traits<binary<Op, L, R>>
+    {
+        static constexpr bool is_operand    = true;
+        static constexpr bool is_expression = true;
+        using value_type = typename binary<Op, L, R>::value_type;
+        static constexpr size_t rows = binary<Op, L, R>::rows;
+        static constexpr size_t cols = binary<Op, L, R>::cols;
+
+        static value_type element(const binary<Op, L, R>& e, const size_t i) noexcept
+        {
+            return e[i];
+        }
+    };
+
+    template <class T>
+    inline constexpr bool is_operand_v = traits<std::decay_t<T>>::is_operand;
+
+    template <class T>
+    inline constexpr bool is_expression_v = traits<std::decay_t<T>>::is_expression;
+
+    template <class T>
+    using value_t = typename traits<std::decay_t<T>>::value_type;
+
+    template <class T>
+    inline auto element(const T& v, const size_t i) noexcept
+    {
+        return traits<T>::element(v, i);
+    }
+
+    //lvalues are referenced, temporaries are moved inside of the node, so expression
+    //which is kept by "auto" cannot dangle
+    template <class T>
+    using hold_t = std::conditional_t<std::is_lvalue_reference<T>::value, const std::decay_t<T>&, std::decay_t<T>>;
+
+    template <class Op, class L, class R>
+    class binary
+    {
+    private:
+        using lt = traits<std::decay_t<L>>;
+        using rt = traits<std::decay_t<R>>;
+        static_assert(lt::rows == 0 || rt::rows == 0 || (lt::rows == rt::rows && lt::cols == rt::cols),
+                      "Element-wise operations require the same sizes of the matrices.");
+
+        hold_t<L> l;
+        hold_t<R> r;
+    public:
+        using value_type = std::common_type_t<typename lt::value_type, typename rt::value_type>;
+        static constexpr size_t rows = lt::rows ? lt::rows : rt::rows;
+        static constexpr size_t cols = lt::cols ? lt::cols : rt::cols;
+
+        template <class A, class B>
+        binary(A&& a, B&& b) :
+            l(std::forward<A>(a)),
+            r(std::forward<B>(b))
+        {
+        }
+
+        value_type operator[](const size_t i) const noexcept
+        {
+            return static_cast<value_type>(Op{}(element(l, i), element(r, i)));
+        }
+
+        ///forces evaluation into new matrix
+        auto eval() const
+        {
+            return Matrix2D<value_type, rows, cols>(*this);
+        }
+    };
+
+    template <class Op, class L, class R>
+    inline auto make(L&& l, R&& r)
+    {
+        return binary<Op, L, R>(std::forward<L>(l), std::forward<R>(r));
+    }
+}
+
+//matrix or expression by matrix or expression
+#define MEXPR_BINARY_OP(OPERATOR, OP) \
+template <class L, class R, class = std::enable_if_t<mexpr::is_operand_v<L> && mexpr::is_operand_v<R>>> \
+inline auto operator OPERATOR (L&& l, R&& r) \
+{ \
+    return mexpr::make<mexpr::ops::OP>(std::forward<L>(l), std::forward<R>(r)); \
+} \
+template <class L, class = std::enable_if_t<mexpr::is_operand_v<L>>> \
+inline auto operator OPERATOR (L&& l, const mexpr::value_t<L> v) \
+{ \
+    return mexpr::make<mexpr::ops::OP>(std::forward<L>(l), mexpr::scalar<mexpr::value_t<L>>{v}); \
+} \
+template <class R, class = std::enable_if_t<mexpr::is_operand_v<R>>> \
+inline auto operator OPERATOR (const mexpr::value_t<R> v, R&& r) \
+{ \
+    return mexpr::make<mexpr::ops::OP>(mexpr::scalar<mexpr::value_t<R>>{v}, std::forward<R>(r)); \
+}
+
+MEXPR_BINARY_OP(+, add)
+MEXPR_BINARY_OP(-, sub)
+MEXPR_BINARY_OP(*, mul)
+MEXPR_BINARY_OP(/, div)
+
+#undef MEXPR_BINARY_OP
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <new>
+#include <atomic>
+#include <cstddef>
 #include <limits>
+#include <type_traits>
 
 constexpr int inline prefFloatsAlign()
 {
@@ -16,6 +19,20 @@ constexpr int inline prefFloatsAlign()
 #endif
 }
 
+//counters of AlignedAllocator (below) and parallel loops (parallel.h) cost atomic read-modify-write
+//on each event, so they are compiled in only if NN_COUNTERS is 1 (and stay 0 otherwise)
+#ifndef NN_COUNTERS
+#define NN_COUNTERS 0
+#endif
+
+//counters of all allocations done by AlignedAllocator (any type), allows to check that hot loops do not allocate
+struct AlignedAllocStats
+{
+    static constexpr bool enabled = NN_COUNTERS;
+    static inline std::atomic<std::size_t> allocations{0};
+    static inline std::atomic<std::size_t> bytes{0};
+};
+
 //https://stackoverflow.com/questions/60169819/modern-approach-to-making-stdvector-allocate-aligned-memory
 
 /**
@@ -57,6 +74,11 @@ public:
         }
 
         const auto nBytesToAllocate = nElementsToAllocate * sizeof( ElementType );
+        if constexpr (AlignedAllocStats::enabled)
+        {
+            AlignedAllocStats::allocations.fetch_add(1, std::memory_order_relaxed);
+            AlignedAllocStats::bytes.fetch_add(nBytesToAllocate, std::memory_order_relaxed);
+        }
         return reinterpret_cast<ElementType*>(::operator new[](nBytesToAllocate, ALIGNMENT));
     }
 
@@ -68,4 +90,19 @@ public:
          * the one used in new. */
         ::operator delete[]( allocatedPointer, ALIGNMENT );
     }
+
+    //stateless, any instance can free memory of other one, needed by vector's copy assignment
+    using is_always_equal = std::true_type;
+
+    template<class OtherElementType>
+    bool operator==(const AlignedAllocator<OtherElementType, ALIGNMENT_IN_BYTES>&) const noexcept
+    {
+        return true;
+    }
+
+    template<class OtherElementType>
+    bool operator!=(const AlignedAllocator<OtherElementType, ALIGNMENT_IN_BYTES>&) const noexcept
+    {
+        return false;
+    }
 };
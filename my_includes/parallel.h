@@ -0,0 +1,226 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <algorithm>
+#include <execution>
+#include <thread>
+#include <chrono>
+
+#include "cust_iters.h"
+#include "cm_ctors.h"
+
+//Execution selection for loops over matrices. Small loops must not pay for task spawning,
+//so the way loop runs is picked by amount of elements:
+// - sequential: plain loop
+// - vectorized: plain loop with hint to the compiler that iterations are independent
+// - parallel:   loop is split into chunks of PAR_GRAIN elements, chunks run on selected backend
+
+//backends, select by defining PAR_BACKEND before include (or by compiler option)
+#define PAR_BACKEND_STD    0 //std::execution::par, libstdc++ runs it on TBB
+#define PAR_BACKEND_TBB    1 //tbb::parallel_for directly
+#define PAR_BACKEND_OPENMP 2 //needs -fopenmp
+#define PAR_BACKEND_POOL   3 //utility::thread_pool::global(), work-stealing pool of runners.h
+
+#ifndef PAR_BACKEND
+#define PAR_BACKEND PAR_BACKEND_STD
+#endif
+
+//1 enables counters of par::stats (and of AlignedAllocator, see palign.h), they cost atomic
+//read-modify-write per parallel loop
+#ifndef NN_COUNTERS
+#define NN_COUNTERS 0
+#endif
+
+//element-wise loops with less elements run on calling thread
+#ifndef PAR_GRAIN
+#define PAR_GRAIN 65536
+#endif
+
+//element-wise loops with less elements are not worth of vectorization
+#ifndef PAR_VECTOR_MIN
+#define PAR_VECTOR_MIN 16
+#endif
+
+#if PAR_BACKEND == PAR_BACKEND_TBB
+#include <tbb/parallel_for.h>
+#elif PAR_BACKEND == PAR_BACKEND_OPENMP
+#ifndef _OPENMP
+#error "PAR_BACKEND_OPENMP requires OpenMP enabled (-fopenmp)."
+#endif
+#elif PAR_BACKEND == PAR_BACKEND_POOL
+#include "runners.h"
+#elif PAR_BACKEND != PAR_BACKEND_STD
+#error "Unknown PAR_BACKEND."
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define PAR_IVDEP _Pragma("GCC ivdep")
+#elif defined(__clang__)
+#define PAR_IVDEP _Pragma("clang loop vectorize(enable)")
+#else
+#define PAR_IVDEP
+#endif
+
+namespace par
+{
+    //counters of loops sent to backend (any thread), so profiling can tell how much work was split.
+    //Counted only if NN_COUNTERS is 1
+    struct stats
+    {
+        static constexpr bool enabled = NN_COUNTERS;
+        static inline std::atomic<std::size_t> dispatches{0};
+        static inline std::atomic<std::size_t> tasks{0};
+    };
+
+    enum class policy
+    {
+        sequential,
+        vectorized,
+        parallel,
+    };
+
+    constexpr policy select(const size_t count, const size_t grain = PAR_GRAIN) noexcept
+    {
+        if (count < PAR_VECTOR_MIN)
+            return policy::sequential;
+        if (count < 2 * grain)
+            return policy::vectorized;
+        return policy::parallel;
+    }
+
+    namespace details
+    {
+        inline bool& sequential_only() noexcept
+        {
+            static thread_local bool value = false;
+            return value;
+        }
+    }
+
+    ///while it exists, loops of this thread run on this thread only. For threads which already occupy
+    ///the backend (as team members of parallel_trainer), where splitting loops only queues work nobody takes
+    class sequential_scope
+    {
+    public:
+        sequential_scope() noexcept :
+            previous(details::sequential_only())
+        {
+            details::sequential_only() = true;
+        }
+
+        ~sequential_scope()
+        {
+            details::sequential_only() = previous;
+        }
+
+        NO_COPYMOVE(sequential_scope);
+    private:
+        const bool previous;
+    };
+
+    ///calls f(from, to) for consecutive chunks of [0, count), chunks run in parallel on selected backend
+    template <class F>
+    void for_chunks(const size_t count, const size_t grain, F&& f)
+    {
+        const size_t chunks = (count + grain - 1) / grain;
+        if (chunks < 2 || details::sequential_only())
+        {
+            f(size_t{0}, count);
+            return;
+        }
+
+        const auto run = [&f, count, grain](const size_t c)
+        {
+            f(c * grain, std::min(count, (c + 1) * grain));
+        };
+        if constexpr (stats::enabled)
+        {
+            stats::dispatches.fetch_add(1, std::memory_order_relaxed);
+            stats::tasks.fetch_add(chunks, std::memory_order_relaxed);
+        }
+
+#if PAR_BACKEND == PAR_BACKEND_TBB
+        tbb::parallel_for(size_t{0}, chunks, run);
+#elif PAR_BACKEND == PAR_BACKEND_OPENMP
+        #pragma omp parallel for schedule(static)
+        for (long long c = 0; c < static_cast<long long>(chunks); ++c)
+            run(static_cast<size_t>(c));
+#elif PAR_BACKEND == PAR_BACKEND_POOL
+        utility::thread_pool::global().parallel_for(chunks, 1, [&run](const size_t from, const size_t to)
+        {
+            for (size_t c = from; c < to; ++c)
+                run(c);
+        });
+#else
+        std::for_each(std::execution::par, IndexIter(0), IndexIter(chunks), run);
+#endif
+    }
+
+    ///calls f() on every thread which runs chunks of for_chunks() (calling thread included), so thread local
+    ///state (as gemm packing buffers) can be prepared before work which must not allocate. POOL and OPENMP
+    ///reach each thread exactly once. Threads of STD and TBB backends are not addressable: hardware_concurrency()
+    ///tasks run f() and wait for each other (at most 1 second), so f() may run more than once on a thread.
+    template <class F>
+    void each_thread(F&& f)
+    {
+#if PAR_BACKEND == PAR_BACKEND_OPENMP
+        #pragma omp parallel
+        f();
+#elif PAR_BACKEND == PAR_BACKEND_POOL
+        auto& pool = utility::thread_pool::global();
+        utility::barrier all(pool.size() + 1);
+        //members wait for each other, so no thread runs 2 of them
+        pool.run_team(pool.size() + 1, [&f, &all](const size_t)
+        {
+            f();
+            all.wait();
+        });
+#else
+        const size_t n = std::max(1u, std::thread::hardware_concurrency());
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        std::atomic<size_t> arrived{0};
+        const auto member = [&f, &arrived, n, deadline](const size_t)
+        {
+            f();
+            arrived.fetch_add(1, std::memory_order_acq_rel);
+            while (arrived.load(std::memory_order_acquire) < n && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::yield();
+        };
+#if PAR_BACKEND == PAR_BACKEND_TBB
+        tbb::parallel_for(size_t{0}, n, member);
+#else
+        std::for_each(std::execution::par, IndexIter(0), IndexIter(n), member);
+#endif
+#endif
+    }
+
+    ///calls f(i) for all i in [0, Count), the way loop runs is selected at compile time by Count
+    template <size_t Count, size_t Grain = PAR_GRAIN, class F>
+    void for_each_index(F&& f)
+    {
+        constexpr auto p = select(Count, Grain);
+
+        if constexpr (p == policy::sequential)
+        {
+            for (size_t i = 0; i < Count; ++i)
+                f(i);
+        }
+
+        if constexpr (p == policy::vectorized)
+        {
+            PAR_IVDEP
+            for (size_t i = 0; i < Count; ++i)
+                f(i);
+        }
+
+        if constexpr (p == policy::parallel)
+        {
+            for_chunks(Count, Grain, [&f](const size_t from, const size_t to)
+            {
+                PAR_IVDEP
+                for (size_t i = from; i < to; ++i)
+                    f(i);
+            });
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//symmetric int8 quantization: x ~ q * scale, q in [-127; 127] (-128 is never produced, so
+//AVX2 sign trick below cannot overflow), products are accumulated in int32.
+namespace quant
+{
+    ///values are padded to multiple of this by zeros, so kernels have no tails
+    constexpr size_t block = 32;
+
+    constexpr size_t padded(const size_t count) noexcept
+    {
+        return (count + block - 1) / block * block;
+    }
+
+    ///scale which maps max(|src|) to 127, 0 values give scale 1 to avoid division by 0
+    template <class T>
+    inline float scale_of(const T* src, const size_t count) noexcept
+    {
+        T m = 0;
+        for (size_t i = 0; i < count; ++i)
+            m = std::max(m, std::fabs(src[i]));
+        return m > T(0) ? static_cast<float>(m) / 127.f : 1.f;
+    }
+
+    ///dst[i] = round(src[i] / scale), values after count up to padded(count) are zeroed
+    template <class T>
+    inline void quantize(const T* src, const size_t count, const float scale, int8_t* dst) noexcept
+    {
+        const float inv = 1.f / scale;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float q = std::nearbyint(static_cast<float>(src[i]) * inv);
+            dst[i] = static_cast<int8_t>(std::clamp(q, -127.f, 127.f));
+        }
+        std::fill(dst + count, dst + padded(count), int8_t{0});
+    }
+
+    namespace details
+    {
+        inline int32_t dot_scalar(const int8_t* a, const int8_t* b, const size_t count) noexcept
+        {
+            int32_t sum = 0;
+            for (size_t i = 0; i < count; ++i)
+                sum += int32_t{a[i]} * int32_t{b[i]};
+            return sum;
+        }
+
+#if defined(__AVX2__)
+        //|a| * sign(b, a) keeps product sign, so unsigned x signed maddubs can be used:
+        //pair of products is at most 2 * 127 * 127 and fits int16 without saturation
+        inline __m256i dot32(const __m256i a, const __m256i b, const __m256i acc) noexcept
+        {
+            const __m256i p16 = _mm256_maddubs_epi16(_mm256_abs_epi8(a), _mm256_sign_epi8(b, a));
+            return _mm256_add_epi32(acc, _mm256_madd_epi16(p16, _mm256_set1_epi16(1)));
+        }
+
+        inline int32_t hsum(const __m256i v) noexcept
+        {
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(s);
+        }
+#endif
+    }
+
+    ///sum of a[i] * b[i], count is multiple of block, both pointers are aligned to block
+    inline int32_t dot(const int8_t* a, const int8_t* b, const size_t count) noexcept
+    {
+#if defined(__AVX2__)
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 2 * block <= count; i += 2 * block)
+        {
+            acc0 = details::dot32(_mm256_load_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                  _mm256_load_si256(reinterpret_cast<const __m256i*>(b + i)), acc0);
+            acc1 = details::dot32(_mm256_load_si256(reinterpret_cast<const __m256i*>(a + i + block)),
+                                  _mm256_load_si256(reinterpret_cast<const __m256i*>(b + i + block)), acc1);
+        }
+        if (i < count)
+            acc0 = details::dot32(_mm256_load_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                  _mm256_load_si256(reinterpret_cast<const __m256i*>(b + i)), acc0);
+        return details::hsum(_mm256_add_epi32(acc0, acc1));
+#else
+        return details::dot_scalar(a, b, count);
+#endif
+    }
+}
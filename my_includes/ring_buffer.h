@@ -0,0 +1,395 @@
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <condition_variable>
+
+#include "cm_ctors.h"
+
+//bounded lock-free queues used as transport between pipeline threads (loader, preprocessing, trainer):
+// - spsc_ring: exactly 1 producer and 1 consumer thread
+// - mpmc_ring: any amount of producers and consumers (per slot sequence numbers, D. Vyukov's scheme)
+//try_* calls never block. push/pop calls wait for space/items: spin, then yield, then sleep on
+//condition variable, so idle pipeline stage does not burn the core. Sleeping side is woken by the
+//opposite side only if it really sleeps, so uncontended transfer does not touch any mutex.
+//Capacity is rounded up to power of 2.
+namespace utility
+{
+    //destructive interference size, std::hardware_destructive_interference_size is not in all compilers yet
+    constexpr size_t cache_line = 64;
+
+    namespace details
+    {
+        inline void cpu_relax() noexcept
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        constexpr size_t ring_capacity(const size_t requested) noexcept
+        {
+            size_t c = 2;
+            while (c < requested)
+                c *= 2;
+            return c;
+        }
+
+        //place where thread waits until predicate becomes true
+        class parking
+        {
+        private:
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::atomic<size_t> sleeping{0};
+        public:
+            static constexpr size_t spins  = 256;
+            static constexpr size_t yields = 16;
+
+            template <class Pred>
+            void wait(Pred&& ready)
+            {
+                for (size_t i = 0; i < spins; ++i)
+                {
+                    if (ready())
+                        return;
+                    cpu_relax();
+                }
+                for (size_t i = 0; i < yields; ++i)
+                {
+                    if (ready())
+                        return;
+                    std::this_thread::yield();
+                }
+
+                std::unique_lock<std::mutex> lock(mtx);
+                //both sides do read-modify-write of sleeping, so they are ordered: either notifier sees
+                //the sleeper or sleeper (synchronized with notifier's RMW) sees new state in predicate
+                sleeping.fetch_add(1, std::memory_order_acq_rel);
+                cv.wait(lock, ready);
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            ///must be called after state which predicates check was changed
+            void notify()
+            {
+                if (sleeping.fetch_add(0, std::memory_order_acq_rel))
+                {
+                    //lock ensures sleeper is either inside cv.wait() or has not checked predicate yet
+                    std::lock_guard<std::mutex> lock(mtx);
+                    cv.notify_all();
+                }
+            }
+        };
+
+        //blocking calls and closing built on top of non-blocking try_push_n()/try_pop_n() of Ring
+        template <class Ring, class T>
+        class ring_waits
+        {
+        private:
+            parking not_empty;
+            parking not_full;
+            std::atomic<bool> is_closed{false};
+
+            Ring& self() noexcept
+            {
+                return static_cast<Ring&>(*this);
+            }
+        protected:
+            void pushed(const size_t count)
+            {
+                if (count)
+                    not_empty.notify();
+            }
+
+            void popped(const size_t count)
+            {
+                if (count)
+                    not_full.notify();
+            }
+        public:
+            ///no more items will be pushed: pop calls return what is left and then report end,
+            ///threads waiting in push calls are released
+            void close()
+            {
+                is_closed.store(true);
+                not_empty.notify();
+                not_full.notify();
+            }
+
+            bool closed() const noexcept
+            {
+                return is_closed.load(std::memory_order_acquire);
+            }
+
+            ///waits for free space, returns false (item is not moved) if queue was closed
+            [[nodiscard]]
+            bool push(T&& item)
+            {
+                return push_n(&item, 1) == 1;
+            }
+
+            ///moves all count items, waits for free space when needed,
+            ///returns how many were pushed (less than count only if queue was closed)
+            size_t push_n(T* items, const size_t count)
+            {
+                size_t done = 0;
+                while (done < count && !closed())
+                {
+                    done += self().try_push_n(items + done, count - done);
+                    if (done < count)
+                        not_full.wait([this]()
+                        {
+                            return closed() || !self().full();
+                        });
+                }
+                return done;
+            }
+
+            ///waits for item, returns false when queue is closed and empty
+            [[nodiscard]]
+            bool pop(T& item)
+            {
+                return pop_n(&item, 1) == 1;
+            }
+
+            ///waits for at least 1 item and takes up to count of already available ones,
+            ///returns 0 only when queue is closed and empty
+            size_t pop_n(T* items, const size_t count)
+            {
+                if (!count)
+                    return 0;
+                for (;;)
+                {
+                    if (const size_t n = self().try_pop_n(items, count))
+                        return n;
+                    //items pushed before close() must be taken, so emptiness is checked after seeing closed
+                    if (closed())
+                        return self().try_pop_n(items, count);
+                    not_empty.wait([this]()
+                    {
+                        return closed() || !self().empty();
+                    });
+                }
+            }
+        };
+    }
+
+    ///single producer, single consumer bounded queue
+    template <class T>
+    class spsc_ring : public details::ring_waits<spsc_ring<T>, T>
+    {
+    private:
+        const size_t mask;
+        std::unique_ptr<T[]> items;
+
+        //each index is written by 1 side only, and each side keeps last seen index of the other one,
+        //so shared cache lines are read only when cached value says queue is full/empty
+        alignas(cache_line) std::atomic<size_t> head{0};
+        size_t tail_cached{0};
+        alignas(cache_line) std::atomic<size_t> tail{0};
+        size_t head_cached{0};
+        alignas(cache_line) char padding{0};
+    public:
+        using value_type = T;
+
+        explicit spsc_ring(const size_t capacity) :
+            mask(details::ring_capacity(capacity) - 1),
+            items(new T[mask + 1])
+        {
+        }
+
+        NO_COPYMOVE(spsc_ring);
+        ~spsc_ring() = default;
+
+        size_t capacity() const noexcept
+        {
+            return mask + 1;
+        }
+
+        ///approximate when called from thread other than producer/consumer
+        size_t size() const noexcept
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        bool full() const noexcept
+        {
+            return size() >= capacity();
+        }
+
+        ///producer: moves as many of count items as fits now, returns how many
+        size_t try_push_n(T* src, const size_t count)
+        {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head_cached + count > capacity())
+                head_cached = head.load(std::memory_order_acquire);
+            const size_t n = std::min(count, capacity() - (t - head_cached));
+            for (size_t i = 0; i < n; ++i)
+                items[(t + i) & mask] = std::move(src[i]);
+            if (n)
+                tail.store(t + n, std::memory_order_release);
+            this->pushed(n);
+            return n;
+        }
+
+        [[nodiscard]]
+        bool try_push(T&& item)
+        {
+            return try_push_n(&item, 1) == 1;
+        }
+
+        ///consumer: takes up to count available items, returns how many
+        size_t try_pop_n(T* dst, const size_t count)
+        {
+            const size_t h = head.load(std::memory_order_relaxed);
+            if (tail_cached - h < count)
+                tail_cached = tail.load(std::memory_order_acquire);
+            const size_t n = std::min(count, tail_cached - h);
+            for (size_t i = 0; i < n; ++i)
+                dst[i] = std::move(items[(h + i) & mask]);
+            if (n)
+                head.store(h + n, std::memory_order_release);
+            this->popped(n);
+            return n;
+        }
+
+        [[nodiscard]]
+        bool try_pop(T& item)
+        {
+            return try_pop_n(&item, 1) == 1;
+        }
+    };
+
+    ///multiple producers, multiple consumers bounded queue
+    template <class T>
+    class mpmc_ring : public details::ring_waits<mpmc_ring<T>, T>
+    {
+    private:
+        //slot at position p is free when seq == p and holds item when seq == p + 1,
+        //consumer releases it for the next round by seq = p + capacity
+        struct slot
+        {
+            std::atomic<size_t> seq{0};
+            T value{};
+        };
+
+        const size_t mask;
+        std::unique_ptr<slot[]> slots;
+
+        alignas(cache_line) std::atomic<size_t> head{0};
+        alignas(cache_line) std::atomic<size_t> tail{0};
+        alignas(cache_line) char padding{0};
+
+        //claims up to count consecutive slots at index (head or tail) which have seq == pos + ready,
+        //returns first claimed position and amount
+        std::pair<size_t, size_t> claim(std::atomic<size_t>& index, const size_t count, const size_t ready) noexcept
+        {
+            size_t pos = index.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                size_t n = 0;
+                while (n < count && slots[(pos + n) & mask].seq.load(std::memory_order_acquire) == pos + n + ready)
+                    ++n;
+                if (!n)
+                {
+                    //slot is behind (full/empty) or other thread moved index already
+                    const size_t now = index.load(std::memory_order_relaxed);
+                    if (now == pos)
+                        return {pos, 0};
+                    pos = now;
+                    continue;
+                }
+                if (index.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+                    return {pos, n};
+            }
+        }
+    public:
+        using value_type = T;
+
+        explicit mpmc_ring(const size_t capacity) :
+            mask(details::ring_capacity(capacity) - 1),
+            slots(new slot[mask + 1])
+        {
+            for (size_t i = 0; i <= mask; ++i)
+                slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        NO_COPYMOVE(mpmc_ring);
+        ~mpmc_ring() = default;
+
+        size_t capacity() const noexcept
+        {
+            return mask + 1;
+        }
+
+        ///approximate, includes slots which are being written/read at the moment
+        size_t size() const noexcept
+        {
+            const size_t h = head.load(std::memory_order_acquire);
+            const size_t t = tail.load(std::memory_order_acquire);
+            return t > h ? t - h : 0;
+        }
+
+        bool empty() const noexcept
+        {
+            return size() == 0;
+        }
+
+        bool full() const noexcept
+        {
+            return size() >= capacity();
+        }
+
+        ///moves as many of count items as fits now, returns how many
+        size_t try_push_n(T* src, const size_t count)
+        {
+            const auto [pos, n] = claim(tail, count, 0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                slot& s = slots[(pos + i) & mask];
+                s.value = std::move(src[i]);
+                s.seq.store(pos + i + 1, std::memory_order_release);
+            }
+            this->pushed(n);
+            return n;
+        }
+
+        [[nodiscard]]
+        bool try_push(T&& item)
+        {
+            return try_push_n(&item, 1) == 1;
+        }
+
+        ///takes up to count available items, returns how many
+        size_t try_pop_n(T* dst, const size_t count)
+        {
+            const auto [pos, n] = claim(head, count, 1);
+            for (size_t i = 0; i < n; ++i)
+            {
+                slot& s = slots[(pos + i) & mask];
+                dst[i] = std::move(s.value);
+                s.seq.store(pos + i + capacity(), std::memory_order_release);
+            }
+            this->popped(n);
+            return n;
+        }
+
+        [[nodiscard]]
+        bool try_pop(T& item)
+        {
+            return try_pop_n(&item, 1) == 1;
+        }
+    };
+}
@@ -5,6 +5,17 @@
 #include <functional>
 #include <atomic>
 #include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <future>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+#include "cm_ctors.h"
+#include "ring_buffer.h"
 
 namespace utility
 {
@@ -30,6 +41,481 @@ namespace utility
         });
     }
 
+    //reusable barrier for fixed amount of threads: wait() returns when all of them came into it
+    class barrier
+    {
+    private:
+        std::mutex mtx;
+        std::condition_variable cv;
+        const size_t count;
+        size_t waiting{0};
+        size_t generation{0};
+    public:
+        explicit barrier(const size_t count) :
+            count(count)
+        {
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            const auto gen = generation;
+            if (++waiting == count)
+            {
+                waiting = 0;
+                ++generation;
+                cv.notify_all();
+                return;
+            }
+            cv.wait(lock, [this, gen]()
+            {
+                return gen != generation;
+            });
+        }
+    };
+
+    //move-only callable without arguments, std::function requires copyable target (packaged_task is not)
+    class task
+    {
+    private:
+        struct base
+        {
+            virtual ~base() = default;
+            virtual void run() = 0;
+        };
+
+        template <class F>
+        struct impl : base
+        {
+            F f;
+
+            explicit impl(F&& f) :
+                f(std::move(f))
+            {
+            }
+
+            void run() override
+            {
+                f();
+            }
+        };
+
+        std::unique_ptr<base> fn;
+    public:
+        task() = default;
+        ~task() = default;
+        MOVEONLY_ALLOWED(task);
+
+        template <class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, task>::value>>
+        explicit task(F&& f) :
+            fn(new impl<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(f))))
+        {
+        }
+
+        void operator()()
+        {
+            fn->run();
+        }
+    };
+
+    namespace details
+    {
+        //state of 1 thread_pool::parallel_for() call, it is kept on the stack of calling thread.
+        //Helpers get it by ticket in queue of the pool, ticket is counted in active when it is taken
+        //(under lock of the queue), tickets not taken till the end of the loop are removed by caller,
+        //so nobody touches the state after caller saw active == 0.
+        struct loop_state
+        {
+            void (*call)(void* fn, size_t from, size_t to){nullptr};
+            void* fn{nullptr};
+            size_t count{0};
+            size_t step{1};
+            size_t chunks{0};
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::atomic<size_t> active{0};
+            std::atomic<bool> failed{false};
+            std::mutex error_mtx;
+            std::exception_ptr error;
+
+            //takes chunks until all of them are taken, the first exception is kept
+            void run() noexcept
+            {
+                for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;)
+                {
+                    if (!failed.load(std::memory_order_relaxed))
+                    {
+                        try
+                        {
+                            call(fn, c * step, std::min(count, (c + 1) * step));
+                        }
+                        catch (...)
+                        {
+                            std::lock_guard<std::mutex> lock(error_mtx);
+                            if (!error)
+                                error = std::current_exception();
+                            failed.store(true, std::memory_order_relaxed);
+                        }
+                    }
+                    done.fetch_add(1, std::memory_order_release);
+                }
+            }
+        };
+    }
+
+    //persistent threads with own task deque each: owner takes newest task (LIFO, hot caches),
+    //idle workers steal the oldest ones from others (FIFO, the biggest pieces of work).
+    //Idle workers spin a bit and then sleep, so pool costs nothing when there is no work.
+    class thread_pool
+    {
+    private:
+        //queued work: task or ticket of parallel_for() helper (no allocation per helper)
+        struct item
+        {
+            task fn;
+            details::loop_state* loop{nullptr};
+        };
+
+        //deque of items on ring which only grows, so queueing does not allocate once it took
+        //the biggest amount of items (std::deque frees and allocates blocks as items go through)
+        class item_ring
+        {
+        private:
+            std::vector<item> buf = std::vector<item>(16);
+            size_t head{0};
+            size_t count{0};
+
+            item& at(const size_t i) noexcept
+            {
+                return buf[(head + i) & (buf.size() - 1)];
+            }
+        public:
+            bool empty() const noexcept
+            {
+                return !count;
+            }
+
+            void push_back(item&& t)
+            {
+                if (count == buf.size())
+                {
+                    std::vector<item> bigger(buf.size() * 2);
+                    for (size_t i = 0; i < count; ++i)
+                        bigger[i] = std::move(at(i));
+                    buf.swap(bigger);
+                    head = 0;
+                }
+                at(count++) = std::move(t);
+            }
+
+            item pop_back() noexcept
+            {
+                return std::move(at(--count));
+            }
+
+            item pop_front() noexcept
+            {
+                item t = std::move(at(0));
+                head = (head + 1) & (buf.size() - 1);
+                --count;
+                return t;
+            }
+
+            ///removes items matching pred keeping order of others, returns how many were removed
+            template <class Pred>
+            size_t remove_if(Pred&& pred)
+            {
+                size_t kept = 0;
+                for (size_t i = 0; i < count; ++i)
+                    if (!pred(at(i)))
+                    {
+                        if (kept != i)
+                            at(kept) = std::move(at(i));
+                        ++kept;
+                    }
+                const size_t removed = count - kept;
+                for (size_t i = kept; i < count; ++i)
+                    at(i) = item();
+                count = kept;
+                return removed;
+            }
+        };
+
+        struct alignas(cache_line) worker_queue
+        {
+            std::mutex mtx;
+            item_ring tasks;
+        };
+
+        std::vector<std::unique_ptr<worker_queue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> pending{0};
+        std::atomic<size_t> next_queue{0};
+        std::atomic<bool> stopping{false};
+        details::parking idle;
+        //callers of parallel_for() wait here for their helpers, it is pool's, so helper may notify it
+        //after it left the loop state
+        details::parking loops;
+
+        struct current_worker
+        {
+            const thread_pool* pool{nullptr};
+            size_t index{0};
+        };
+
+        static current_worker& current() noexcept
+        {
+            static thread_local current_worker w;
+            return w;
+        }
+
+        //tasks submitted by worker of this pool go to its own deque, others are spread round robin
+        size_t home_queue() noexcept
+        {
+            const auto& w = current();
+            if (w.pool == this)
+                return w.index;
+            return next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        }
+
+        void push(item&& t, const size_t queue)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queues[queue]->mtx);
+                queues[queue]->tasks.push_back(std::move(t));
+            }
+            pending.fetch_add(1, std::memory_order_release);
+            idle.notify();
+        }
+
+        //ticket of parallel_for() is counted as active while queue is locked, see details::loop_state
+        static item pop_taken(item_ring& tasks, const bool back)
+        {
+            item t = back ? tasks.pop_back() : tasks.pop_front();
+            if (t.loop)
+                t.loop->active.fetch_add(1, std::memory_order_relaxed);
+            return t;
+        }
+
+        bool take(const size_t index, item& t)
+        {
+            {
+                auto& own = *queues[index];
+                std::lock_guard<std::mutex> lock(own.mtx);
+                if (!own.tasks.empty())
+                {
+                    t = pop_taken(own.tasks, true);
+                    pending.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues.size(); ++i)
+            {
+                auto& victim = *queues[(index + i) % queues.size()];
+                std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+                if (lock && !victim.tasks.empty())
+                {
+                    t = pop_taken(victim.tasks, false);
+                    pending.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run(item& t)
+        {
+            if (!t.loop)
+            {
+                t.fn();
+                return;
+            }
+            t.loop->run();
+            //the last access to loop state, caller may leave parallel_for() right after it
+            t.loop->active.fetch_sub(1, std::memory_order_release);
+            loops.notify();
+        }
+
+        //removes tickets of the loop which were not taken from the queue
+        void cancel(const details::loop_state& st, const size_t queue)
+        {
+            size_t removed = 0;
+            {
+                auto& q = *queues[queue];
+                std::lock_guard<std::mutex> lock(q.mtx);
+                removed = q.tasks.remove_if([&st](const item& t)
+                {
+                    return t.loop == &st;
+                });
+            }
+            pending.fetch_sub(removed, std::memory_order_relaxed);
+        }
+
+        void work(const size_t index)
+        {
+            current() = {this, index};
+            for (;;)
+            {
+                item t;
+                if (take(index, t))
+                {
+                    run(t);
+                    continue;
+                }
+                //queued tasks are finished before stop
+                if (stopping.load(std::memory_order_acquire) && !pending.load(std::memory_order_acquire))
+                    break;
+                idle.wait([this]()
+                {
+                    return pending.load(std::memory_order_acquire) || stopping.load(std::memory_order_acquire);
+                });
+            }
+        }
+    public:
+        ///all cores, calling thread of parallel_for() / run_team() takes 1 of them
+        static size_t default_threads() noexcept
+        {
+            const unsigned cores = std::thread::hardware_concurrency();
+            return cores > 2 ? cores - 1 : 1;
+        }
+
+        explicit thread_pool(const size_t count = default_threads())
+        {
+            const size_t n = std::max<size_t>(1, count);
+            queues.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+                queues.push_back(std::make_unique<worker_queue>());
+            threads.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+                threads.emplace_back(&thread_pool::work, this, i);
+        }
+
+        NO_COPYMOVE(thread_pool);
+
+        ~thread_pool()
+        {
+            stopping.store(true, std::memory_order_release);
+            idle.notify();
+            for (auto& t : threads)
+                t.join();
+        }
+
+        ///shared pool used by parallel backend (see parallel.h) and parallel_trainer
+        static thread_pool& global()
+        {
+            static thread_pool pool;
+            return pool;
+        }
+
+        size_t size() const noexcept
+        {
+            return threads.size();
+        }
+
+        ///runs f() on the pool, exception thrown by f is rethrown by future::get()
+        template <class F>
+        auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+        {
+            using res_t = std::invoke_result_t<std::decay_t<F>>;
+            std::packaged_task<res_t()> pt(std::forward<F>(f));
+            auto res = pt.get_future();
+            push({task(std::move(pt))}, home_queue());
+            return res;
+        }
+
+        ///calls f(from, to) for consecutive chunks of grain elements of [0, count).
+        ///Calling thread runs chunks too, so nested calls from tasks of the pool cannot deadlock.
+        ///The first exception thrown by f is rethrown here after all started chunks are finished.
+        template <class F>
+        void parallel_for(const size_t count, const size_t grain, F&& f)
+        {
+            const size_t step   = std::max<size_t>(1, grain);
+            const size_t chunks = (count + step - 1) / step;
+            if (chunks < 2)
+            {
+                if (count)
+                    f(size_t{0}, count);
+                return;
+            }
+
+            //state is on this stack: nothing is allocated per call (helpers are queued as tickets)
+            details::loop_state st;
+            st.call = [](void* fn, const size_t from, const size_t to)
+            {
+                (*static_cast<std::remove_reference_t<F>*>(fn))(from, to);
+            };
+            st.fn     = const_cast<void*>(static_cast<const void*>(std::addressof(f)));
+            st.count  = count;
+            st.step   = step;
+            st.chunks = chunks;
+
+            const size_t helpers = std::min(chunks - 1, size());
+            const size_t first   = home_queue();
+            const bool own       = current().pool == this;
+            for (size_t h = 0; h < helpers; ++h)
+                push({task(), &st}, own ? first : (first + h) % queues.size());
+
+            st.run();
+            //all chunks are taken, tickets which are still queued would find no work
+            for (size_t h = 0; h < (own ? 1 : helpers); ++h)
+                cancel(st, (first + h) % queues.size());
+            loops.wait([&st, chunks]()
+            {
+                return st.done.load(std::memory_order_acquire) == chunks && !st.active.load(std::memory_order_acquire);
+            });
+            if (st.error)
+                std::rethrow_exception(st.error);
+        }
+
+        ///runs f(0), ..., f(n - 1) at the same time (so they may wait for each other, e.g. on barrier),
+        ///f(0) on calling thread. Needs n - 1 free workers: it must not be used from tasks of the pool.
+        template <class F>
+        void run_team(const size_t n, F&& f)
+        {
+            if (n > size() + 1)
+                throw std::range_error("Team is bigger than thread pool.");
+
+            std::vector<std::future<void>> members;
+            members.reserve(n);
+            const size_t first = next_queue.fetch_add(n, std::memory_order_relaxed);
+            for (size_t w = 1; w < n; ++w)
+            {
+                std::packaged_task<void()> pt([&f, w]()
+                {
+                    f(w);
+                });
+                members.push_back(pt.get_future());
+                push({task(std::move(pt))}, (first + w) % queues.size());
+            }
+
+            std::exception_ptr error;
+            try
+            {
+                if (n)
+                    f(size_t{0});
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            //members reference f, so all of them are finished before leaving
+            for (auto& m : members)
+            {
+                try
+                {
+                    m.get();
+                }
+                catch (...)
+                {
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
     inline size_t currentThreadId()
     {
         return std::hash<std::thread::id> {}(std::this_thread::get_id());
@@ -18,7 +18,9 @@ private:
     mutable std::mutex mtx;
     std::condition_variable cv;
     std::condition_variable sync_wait;
+    std::condition_variable not_full;
     bool finish_processing = false;
+    bool closed = false;
     int sync_counter = 0;
 
     void decSyncCounter()
@@ -48,6 +50,34 @@ public:
         cv.notify_one();
     }
 
+    ///bounded push: waits while queue has max_size or more items,
+    ///returns false (item is dropped) if queue was closed
+    [[nodiscard]]
+    bool pushSync(T&& item, const size_type max_size)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this, max_size]
+        {
+            return q.size() < max_size || closed;
+        });
+        if (closed)
+            return false;
+
+        q.push(std::move(item));
+        cv.notify_one();
+        return true;
+    }
+
+    ///no more items will be pushed: popSync() returns false once queue is empty,
+    ///producers blocked in pushSync() are released
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        cv.notify_all();
+        not_full.notify_all();
+    }
+
     template <class ...Args>
     void emplace(Args ...args)
     {
@@ -69,6 +99,7 @@ public:
         }
         item = std::move(q.front());
         q.pop();
+        not_full.notify_one();
         return true;
     }
 
@@ -80,7 +111,7 @@ public:
 
         cv.wait(lock, [this]
         {
-            return !q.empty() || finish_processing;
+            return !q.empty() || finish_processing || closed;
         });
 
         bool res;
@@ -88,6 +119,7 @@ public:
         {
             item = std::move(q.front());
             q.pop();
+            not_full.notify_one();
         }
         decSyncCounter();
         return res;
@@ -0,0 +1,572 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+//thin wrappers over SIMD registers, so kernels can be written once and compiled for
+//AVX-512 / AVX2 or as plain scalar code (1 lane) when nothing better is available.
+//round/pow2i/frexp_sqrt2 (used by vmath.h) exist for float vectors and scalars only.
+namespace simd
+{
+    //scalar fallback, used for any arithmetic type without native vector
+    template <class T>
+    struct scalar
+    {
+        static_assert(std::is_arithmetic<T>::value, "Only numbers are supported.");
+        static constexpr size_t width = 1;
+        T v;
+
+        static scalar zero() noexcept
+        {
+            return {T(0)};
+        }
+
+        static scalar set1(const T x) noexcept
+        {
+            return {x};
+        }
+
+        static scalar load(const T* p) noexcept
+        {
+            return {*p};
+        }
+
+        static scalar loadu(const T* p) noexcept
+        {
+            return {*p};
+        }
+
+        void store(T* p) const noexcept
+        {
+            *p = v;
+        }
+
+        void storeu(T* p) const noexcept
+        {
+            *p = v;
+        }
+
+        T reduce_add() const noexcept
+        {
+            return v;
+        }
+
+        friend scalar operator + (const scalar a, const scalar b) noexcept
+        {
+            return {a.v + b.v};
+        }
+
+        friend scalar operator - (const scalar a, const scalar b) noexcept
+        {
+            return {a.v - b.v};
+        }
+
+        friend scalar operator * (const scalar a, const scalar b) noexcept
+        {
+            return {a.v * b.v};
+        }
+
+        friend scalar operator / (const scalar a, const scalar b) noexcept
+        {
+            return {a.v / b.v};
+        }
+
+        //a * b + c
+        friend scalar fma(const scalar a, const scalar b, const scalar c) noexcept
+        {
+            return {a.v * b.v + c.v};
+        }
+
+        friend scalar min(const scalar a, const scalar b) noexcept
+        {
+            return {std::min(a.v, b.v)};
+        }
+
+        friend scalar max(const scalar a, const scalar b) noexcept
+        {
+            return {std::max(a.v, b.v)};
+        }
+
+        friend scalar sqrt(const scalar a) noexcept
+        {
+            return {std::sqrt(a.v)};
+        }
+
+        //rounds to nearest integer, |a| must be less than 2^(mantissa bits - 1)
+        friend scalar round(const scalar a) noexcept
+        {
+            const T magic = T(1.5) * static_cast<T>(bits_t(1) << mant_bits);
+            return {(a.v + magic) - magic};
+        }
+
+        //2^n, n must be integer value in normal exponent range
+        friend scalar pow2i(const scalar n) noexcept
+        {
+            const auto e = static_cast<bits_t>(static_cast<sbits_t>(n.v) + std::numeric_limits<T>::max_exponent - 1);
+            return {from_bits(e << mant_bits)};
+        }
+
+        //splits positive normal x = m * 2^e, where m is in [sqrt(0.5), sqrt(2)), returns m;
+        //bits are shifted by sqrt(0.5) first, so exponent/mantissa split happens at sqrt(0.5)
+        friend scalar frexp_sqrt2(const scalar x, scalar& e) noexcept
+        {
+            const bits_t sqrt_half = to_bits(T(0.70710678118654752440));
+            const bits_t t = to_bits(x.v) - sqrt_half;
+            e.v = static_cast<T>(static_cast<sbits_t>(t) >> mant_bits);
+            return {from_bits((t & ((bits_t(1) << mant_bits) - 1)) + sqrt_half)};
+        }
+    private:
+        //bit manipulations are used by float and double only
+        using bits_t  = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+        using sbits_t = std::make_signed_t<bits_t>;
+        static constexpr int mant_bits = std::numeric_limits<T>::digits - 1;
+
+        static bits_t to_bits(const T x) noexcept
+        {
+            bits_t b;
+            std::memcpy(&b, &x, sizeof(b));
+            return b;
+        }
+
+        static T from_bits(const bits_t b) noexcept
+        {
+            T x;
+            std::memcpy(&x, &b, sizeof(x));
+            return x;
+        }
+    };
+
+#if defined(__AVX512F__)
+    struct f32x16
+    {
+        static constexpr size_t width = 16;
+        //intrinsics which start from undefined register trigger false -Wmaybe-uninitialized on GCC 12,
+        //zero-masked forms with all lanes enabled are used instead of them
+        static constexpr __mmask16 all = 0xffff;
+        __m512 v;
+
+        static f32x16 zero() noexcept
+        {
+            return {_mm512_setzero_ps()};
+        }
+
+        static f32x16 set1(const float x) noexcept
+        {
+            return {_mm512_set1_ps(x)};
+        }
+
+        static f32x16 load(const float* p) noexcept
+        {
+            return {_mm512_load_ps(p)};
+        }
+
+        static f32x16 loadu(const float* p) noexcept
+        {
+            return {_mm512_loadu_ps(p)};
+        }
+
+        void store(float* p) const noexcept
+        {
+            _mm512_store_ps(p, v);
+        }
+
+        void storeu(float* p) const noexcept
+        {
+            _mm512_storeu_ps(p, v);
+        }
+
+        //_mm512_reduce_add_ps triggers false -Wmaybe-uninitialized on GCC 12
+        float reduce_add() const noexcept
+        {
+            alignas(64) float tmp[width];
+            _mm512_store_ps(tmp, v);
+            float s = 0.f;
+            for (const auto f : tmp)
+                s += f;
+            return s;
+        }
+
+        friend f32x16 operator + (const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_add_ps(a.v, b.v)};
+        }
+
+        friend f32x16 operator * (const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_mul_ps(a.v, b.v)};
+        }
+
+        friend f32x16 fma(const f32x16 a, const f32x16 b, const f32x16 c) noexcept
+        {
+            return {_mm512_fmadd_ps(a.v, b.v, c.v)};
+        }
+
+        friend f32x16 operator - (const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_sub_ps(a.v, b.v)};
+        }
+
+        friend f32x16 operator / (const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_div_ps(a.v, b.v)};
+        }
+
+        friend f32x16 min(const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_maskz_min_ps(all, a.v, b.v)};
+        }
+
+        friend f32x16 max(const f32x16 a, const f32x16 b) noexcept
+        {
+            return {_mm512_maskz_max_ps(all, a.v, b.v)};
+        }
+
+        friend f32x16 sqrt(const f32x16 a) noexcept
+        {
+            return {_mm512_maskz_sqrt_ps(all, a.v)};
+        }
+
+        friend f32x16 round(const f32x16 a) noexcept
+        {
+            return {_mm512_maskz_roundscale_ps(all, a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+        }
+
+        //2^n, n must be integer value in [-126; 127]
+        friend f32x16 pow2i(const f32x16 n) noexcept
+        {
+            const auto e = _mm512_add_epi32(_mm512_maskz_cvtps_epi32(all, n.v), _mm512_set1_epi32(127));
+            return {_mm512_castsi512_ps(_mm512_maskz_slli_epi32(all, e, 23))};
+        }
+
+        //splits positive normal x = m * 2^e, where m is in [sqrt(0.5), sqrt(2)), returns m;
+        //bits are shifted by sqrt(0.5) first, so exponent/mantissa split happens at sqrt(0.5)
+        friend f32x16 frexp_sqrt2(const f32x16 x, f32x16& e) noexcept
+        {
+            const auto sqrt_half = _mm512_set1_epi32(0x3f3504f3);
+            const auto t = _mm512_sub_epi32(_mm512_castps_si512(x.v), sqrt_half);
+            e.v = _mm512_maskz_cvtepi32_ps(all, _mm512_maskz_srai_epi32(all, t, 23));
+            const auto m = _mm512_add_epi32(_mm512_and_si512(t, _mm512_set1_epi32(0x007fffff)), sqrt_half);
+            return {_mm512_castsi512_ps(m)};
+        }
+    };
+
+    struct f64x8
+    {
+        static constexpr size_t width = 8;
+        static constexpr __mmask8 all = 0xff;
+        __m512d v;
+
+        static f64x8 zero() noexcept
+        {
+            return {_mm512_setzero_pd()};
+        }
+
+        static f64x8 set1(const double x) noexcept
+        {
+            return {_mm512_set1_pd(x)};
+        }
+
+        static f64x8 load(const double* p) noexcept
+        {
+            return {_mm512_load_pd(p)};
+        }
+
+        static f64x8 loadu(const double* p) noexcept
+        {
+            return {_mm512_loadu_pd(p)};
+        }
+
+        void store(double* p) const noexcept
+        {
+            _mm512_store_pd(p, v);
+        }
+
+        void storeu(double* p) const noexcept
+        {
+            _mm512_storeu_pd(p, v);
+        }
+
+        double reduce_add() const noexcept
+        {
+            alignas(64) double tmp[width];
+            _mm512_store_pd(tmp, v);
+            double s = 0.;
+            for (const auto f : tmp)
+                s += f;
+            return s;
+        }
+
+        friend f64x8 operator + (const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_add_pd(a.v, b.v)};
+        }
+
+        friend f64x8 operator * (const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_mul_pd(a.v, b.v)};
+        }
+
+        friend f64x8 fma(const f64x8 a, const f64x8 b, const f64x8 c) noexcept
+        {
+            return {_mm512_fmadd_pd(a.v, b.v, c.v)};
+        }
+
+        friend f64x8 operator - (const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_sub_pd(a.v, b.v)};
+        }
+
+        friend f64x8 operator / (const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_div_pd(a.v, b.v)};
+        }
+
+        friend f64x8 min(const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_maskz_min_pd(all, a.v, b.v)};
+        }
+
+        friend f64x8 max(const f64x8 a, const f64x8 b) noexcept
+        {
+            return {_mm512_maskz_max_pd(all, a.v, b.v)};
+        }
+
+        friend f64x8 sqrt(const f64x8 a) noexcept
+        {
+            return {_mm512_maskz_sqrt_pd(all, a.v)};
+        }
+    };
+#elif defined(__AVX2__) && defined(__FMA__)
+    struct f32x8
+    {
+        static constexpr size_t width = 8;
+        __m256 v;
+
+        static f32x8 zero() noexcept
+        {
+            return {_mm256_setzero_ps()};
+        }
+
+        static f32x8 set1(const float x) noexcept
+        {
+            return {_mm256_set1_ps(x)};
+        }
+
+        static f32x8 load(const float* p) noexcept
+        {
+            return {_mm256_load_ps(p)};
+        }
+
+        static f32x8 loadu(const float* p) noexcept
+        {
+            return {_mm256_loadu_ps(p)};
+        }
+
+        void store(float* p) const noexcept
+        {
+            _mm256_store_ps(p, v);
+        }
+
+        void storeu(float* p) const noexcept
+        {
+            _mm256_storeu_ps(p, v);
+        }
+
+        float reduce_add() const noexcept
+        {
+            const __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            const __m128 s2 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+            return _mm_cvtss_f32(_mm_add_ss(s2, _mm_movehdup_ps(s2)));
+        }
+
+        friend f32x8 operator + (const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_add_ps(a.v, b.v)};
+        }
+
+        friend f32x8 operator * (const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_mul_ps(a.v, b.v)};
+        }
+
+        friend f32x8 fma(const f32x8 a, const f32x8 b, const f32x8 c) noexcept
+        {
+            return {_mm256_fmadd_ps(a.v, b.v, c.v)};
+        }
+
+        friend f32x8 operator - (const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_sub_ps(a.v, b.v)};
+        }
+
+        friend f32x8 operator / (const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_div_ps(a.v, b.v)};
+        }
+
+        friend f32x8 min(const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_min_ps(a.v, b.v)};
+        }
+
+        friend f32x8 max(const f32x8 a, const f32x8 b) noexcept
+        {
+            return {_mm256_max_ps(a.v, b.v)};
+        }
+
+        friend f32x8 sqrt(const f32x8 a) noexcept
+        {
+            return {_mm256_sqrt_ps(a.v)};
+        }
+
+        friend f32x8 round(const f32x8 a) noexcept
+        {
+            return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+        }
+
+        //2^n, n must be integer value in [-126; 127]
+        friend f32x8 pow2i(const f32x8 n) noexcept
+        {
+            const auto e = _mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127));
+            return {_mm256_castsi256_ps(_mm256_slli_epi32(e, 23))};
+        }
+
+        //splits positive normal x = m * 2^e, where m is in [sqrt(0.5), sqrt(2)), returns m;
+        //bits are shifted by sqrt(0.5) first, so exponent/mantissa split happens at sqrt(0.5)
+        friend f32x8 frexp_sqrt2(const f32x8 x, f32x8& e) noexcept
+        {
+            const auto sqrt_half = _mm256_set1_epi32(0x3f3504f3);
+            const auto t = _mm256_sub_epi32(_mm256_castps_si256(x.v), sqrt_half);
+            e.v = _mm256_cvtepi32_ps(_mm256_srai_epi32(t, 23));
+            const auto m = _mm256_add_epi32(_mm256_and_si256(t, _mm256_set1_epi32(0x007fffff)), sqrt_half);
+            return {_mm256_castsi256_ps(m)};
+        }
+    };
+
+    struct f64x4
+    {
+        static constexpr size_t width = 4;
+        __m256d v;
+
+        static f64x4 zero() noexcept
+        {
+            return {_mm256_setzero_pd()};
+        }
+
+        static f64x4 set1(const double x) noexcept
+        {
+            return {_mm256_set1_pd(x)};
+        }
+
+        static f64x4 load(const double* p) noexcept
+        {
+            return {_mm256_load_pd(p)};
+        }
+
+        static f64x4 loadu(const double* p) noexcept
+        {
+            return {_mm256_loadu_pd(p)};
+        }
+
+        void store(double* p) const noexcept
+        {
+            _mm256_store_pd(p, v);
+        }
+
+        void storeu(double* p) const noexcept
+        {
+            _mm256_storeu_pd(p, v);
+        }
+
+        double reduce_add() const noexcept
+        {
+            const __m128d s2 = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+            return _mm_cvtsd_f64(_mm_add_sd(s2, _mm_unpackhi_pd(s2, s2)));
+        }
+
+        friend f64x4 operator + (const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_add_pd(a.v, b.v)};
+        }
+
+        friend f64x4 operator * (const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_mul_pd(a.v, b.v)};
+        }
+
+        friend f64x4 fma(const f64x4 a, const f64x4 b, const f64x4 c) noexcept
+        {
+            return {_mm256_fmadd_pd(a.v, b.v, c.v)};
+        }
+
+        friend f64x4 operator - (const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_sub_pd(a.v, b.v)};
+        }
+
+        friend f64x4 operator / (const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_div_pd(a.v, b.v)};
+        }
+
+        friend f64x4 min(const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_min_pd(a.v, b.v)};
+        }
+
+        friend f64x4 max(const f64x4 a, const f64x4 b) noexcept
+        {
+            return {_mm256_max_pd(a.v, b.v)};
+        }
+
+        friend f64x4 sqrt(const f64x4 a) noexcept
+        {
+            return {_mm256_sqrt_pd(a.v)};
+        }
+    };
+#endif
+
+    //native register for type if there is one, scalar otherwise
+    template <class T>
+    struct native
+    {
+        using type = scalar<T>;
+    };
+
+#if defined(__AVX512F__)
+    template <>
+    struct native<float>
+    {
+        using type = f32x16;
+    };
+
+    template <>
+    struct native<double>
+    {
+        using type = f64x8;
+    };
+#elif defined(__AVX2__) && defined(__FMA__)
+    template <>
+    struct native<float>
+    {
+        using type = f32x8;
+    };
+
+    template <>
+    struct native<double>
+    {
+        using type = f64x4;
+    };
+#endif
+
+    template <class T>
+    using pack = typename native<T>::type;
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "simd.h"
+
+//vectorized transcendental functions used by activations.
+//Polynomial approximations are computed over simd::pack for float (several lanes at once),
+//other types use the same code with simd::scalar.
+namespace vmath
+{
+    enum class accuracy
+    {
+        exact, //libm std::exp/std::log per element
+        high,  //polynomial, abs. error of sigmoid is about 1e-7, of logit about 1e-6 (float coefficients, double too)
+        fast,  //short polynomial, abs. error about 1e-4 (sigmoid) .. 1e-3 (logit)
+    };
+
+    namespace details
+    {
+        template <class T>
+        using vec_t = std::conditional_t<std::is_same<T, float>::value, simd::pack<float>, simd::scalar<T>>;
+
+        //e^x, range reduction x = n * ln2 + r, |r| <= ln2 / 2, then e^x = e^r * 2^n
+        template <accuracy A, class P>
+        inline P exp(P x) noexcept
+        {
+            //keeps 2^n in normal range, result is saturated outside
+            x = min(max(x, P::set1(-87.3f)), P::set1(88.3f));
+            const P n = round(x * P::set1(1.44269504088896341f));
+
+            //ln2 is split into 2 parts (Cody-Waite), so n * ln2_hi is exact
+            P r = fma(n, P::set1(-0.693359375f), x);
+            r   = fma(n, P::set1(2.12194440e-4f), r);
+
+            P y;
+            if constexpr (A == accuracy::fast)
+            {
+                y = fma(P::set1(1.f / 6.f), r, P::set1(0.5f));
+                y = fma(y, r, P::set1(1.f));
+                y = fma(y, r, P::set1(1.f));
+            }
+            else
+            {
+                //cephes expf
+                y = fma(P::set1(1.9875691500e-4f), r, P::set1(1.3981999507e-3f));
+                y = fma(y, r, P::set1(8.3334519073e-3f));
+                y = fma(y, r, P::set1(4.1665795894e-2f));
+                y = fma(y, r, P::set1(1.6666665459e-1f));
+                y = fma(y, r, P::set1(5.0000001201e-1f));
+                y = fma(y, r * r, r + P::set1(1.f));
+            }
+            return y * pow2i(n);
+        }
+
+        //natural logarithm of positive x, x = m * 2^e, then ln(x) = ln(m) + e * ln2
+        template <accuracy A, class T, class P>
+        inline P log(P x) noexcept
+        {
+            //0 and +inf are mapped into the edges of normal range
+            x = min(max(x, P::set1(std::numeric_limits<T>::min())), P::set1(std::numeric_limits<T>::max()));
+            P e;
+            const P m = frexp_sqrt2(x, e);
+            const P f = m - P::set1(1.f);
+
+            if constexpr (A == accuracy::fast)
+            {
+                //ln(m) = 2 * atanh(s), s = f / (2 + f), |s| < 0.172
+                const P s  = f / (f + P::set1(2.f));
+                const P s2 = s * s;
+                const P l  = fma(s2 * s, P::set1(2.f / 3.f), s + s);
+                return fma(e, P::set1(0.693147180559945309f), l);
+            }
+            else
+            {
+                //cephes logf
+                const P z = f * f;
+                P y = fma(P::set1(7.0376836292e-2f), f, P::set1(-1.1514610310e-1f));
+                y = fma(y, f, P::set1(1.1676998740e-1f));
+                y = fma(y, f, P::set1(-1.2420140846e-1f));
+                y = fma(y, f, P::set1(1.4249322787e-1f));
+                y = fma(y, f, P::set1(-1.6668057665e-1f));
+                y = fma(y, f, P::set1(2.0000714765e-1f));
+                y = fma(y, f, P::set1(-2.4999993993e-1f));
+                y = fma(y, f, P::set1(3.3333331174e-1f));
+                y = y * f * z;
+                y = fma(e, P::set1(-2.12194440e-4f), y);
+                y = fma(z, P::set1(-0.5f), y);
+                return fma(e, P::set1(0.693359375f), f + y);
+            }
+        }
+
+        template <accuracy A, class P>
+        inline P sigmoid(const P x) noexcept
+        {
+            const P one = P::set1(1.f);
+            return one / (one + exp<A>(P::zero() - x));
+        }
+
+        template <accuracy A, class T, class P>
+        inline P logit(const P y) noexcept
+        {
+            return log<A, T>(y / (P::set1(1.f) - y));
+        }
+
+        //tanh(x) = 2 * sigmoid(2x) - 1
+        template <accuracy A, class P>
+        inline P tanh(const P x) noexcept
+        {
+            const P two = P::set1(2.f);
+            return fma(two, sigmoid<A>(x * two), P::set1(-1.f));
+        }
+
+        //atanh(y) = ln((1 + y) / (1 - y)) / 2
+        template <accuracy A, class T, class P>
+        inline P atanh(const P y) noexcept
+        {
+            const P one = P::set1(1.f);
+            return P::set1(0.5f) * log<A, T>((one + y) / (one - y));
+        }
+
+        //cos(2 * pi * u) for any u, period is removed by rounding, then cos(2 * pi * |t|) = sin(2 * pi * (1/4 - |t|)),
+        //argument of sin is in [-pi/2, pi/2], odd polynomial up to x^11, abs. error about 1e-7
+        template <class P>
+        inline P cos_2pi(const P u) noexcept
+        {
+            const P t = u - round(u);
+            const P x = (P::set1(0.25f) - max(t, P::zero() - t)) * P::set1(6.28318530717958648f);
+            const P x2 = x * x;
+            P y = fma(P::set1(-2.5052108385e-8f), x2, P::set1(2.7557319224e-6f));
+            y = fma(y, x2, P::set1(-1.9841269841e-4f));
+            y = fma(y, x2, P::set1(8.3333333333e-3f));
+            y = fma(y, x2, P::set1(-1.6666666667e-1f));
+            return fma(y * x2, x, x);
+        }
+
+        //runs f(pack) over full packs and f(scalar) over the tail
+        template <class T, class F>
+        inline void transform(const T* src, T* dst, const size_t count, F&& f) noexcept
+        {
+            using P = vec_t<T>;
+            using S = simd::scalar<T>;
+
+            const size_t full = count - count % P::width;
+            for (size_t i = 0; i < full; i += P::width)
+                f(P::loadu(src + i)).storeu(dst + i);
+            for (size_t i = full; i < count; ++i)
+                f(S::load(src + i)).store(dst + i);
+        }
+    }
+
+    ///dst[i] = 1 / (1 + e^-src[i]), src and dst may be the same
+    template <accuracy A, class T>
+    void sigmoid(const T* src, T* dst, const size_t count) noexcept
+    {
+        static_assert(std::is_floating_point<T>::value, "Expecting floating point type only.");
+        if constexpr (A == accuracy::exact)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = T(1) / (T(1) + std::exp(-src[i]));
+        }
+        else
+            details::transform(src, dst, count, [](const auto x)
+            {
+                return details::sigmoid<A>(x);
+            });
+    }
+
+    ///dst[i] = ln(src[i] / (1 - src[i])), inverse of sigmoid, src and dst may be the same
+    template <accuracy A, class T>
+    void logit(const T* src, T* dst, const size_t count) noexcept
+    {
+        static_assert(std::is_floating_point<T>::value, "Expecting floating point type only.");
+        if constexpr (A == accuracy::exact)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = std::log(src[i] / (T(1) - src[i]));
+        }
+        else
+            details::transform(src, dst, count, [](const auto y)
+            {
+                return details::logit<A, T>(y);
+            });
+    }
+
+    ///dst[i] = tanh(src[i]), src and dst may be the same
+    template <accuracy A, class T>
+    void tanh(const T* src, T* dst, const size_t count) noexcept
+    {
+        static_assert(std::is_floating_point<T>::value, "Expecting floating point type only.");
+        if constexpr (A == accuracy::exact)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = std::tanh(src[i]);
+        }
+        else
+            details::transform(src, dst, count, [](const auto x)
+            {
+                return details::tanh<A>(x);
+            });
+    }
+
+    ///dst[i] = atanh(src[i]), inverse of tanh, src and dst may be the same
+    template <accuracy A, class T>
+    void atanh(const T* src, T* dst, const size_t count) noexcept
+    {
+        static_assert(std::is_floating_point<T>::value, "Expecting floating point type only.");
+        if constexpr (A == accuracy::exact)
+        {
+            for (size_t i = 0; i < count; ++i)
+                dst[i] = std::atanh(src[i]);
+        }
+        else
+            details::transform(src, dst, count, [](const auto y)
+            {
+                return details::atanh<A, T>(y);
+            });
+    }
+}
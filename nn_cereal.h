@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <tuple>
+#include <cstring>
+#include <filesystem>
+
+#include <cereal/cereal.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/binary.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "matrix2d_cereal.h"
+#include "simple_nn.h"
+
+//cereal support of SimpleLayeredNN. Topology (template parameters) is stored before weights
+//and load throws if it differs from the network loaded into, so weights of one topology
+//cannot silently get into another one.
+namespace nn
+{
+    ///stored network has other topology than the network loaded into (file itself is fine),
+    ///caller may train new network then
+    struct topology_mismatch : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    ///description of the network stored in front of weights
+    struct topology
+    {
+        //increased when layout of the stored network changes
+        static constexpr uint32_t current_version = 1;
+
+        uint32_t version{current_version};
+        uint32_t float_size{0};
+        std::vector<uint64_t> layers;
+        std::vector<std::string> activations;
+
+        template <class Net>
+        static topology of()
+        {
+            topology t;
+            t.float_size = sizeof(typename Net::Float);
+            t.layers.assign(Net::layer_sizes.begin(), Net::layer_sizes.end());
+            t.activations = activation_ids<Net>(std::make_index_sequence<Net::layers_count - 1>());
+            return t;
+        }
+
+        std::string to_string() const
+        {
+            std::string s = "float" + std::to_string(float_size * 8) + " [";
+            for (size_t i = 0; i < layers.size(); ++i)
+                s += (i ? ", " : "") + std::to_string(layers[i]);
+            s += "] (";
+            for (size_t i = 0; i < activations.size(); ++i)
+                s += (i ? ", " : "") + activations[i];
+            return s + ")";
+        }
+
+        bool operator ==(const topology& t) const
+        {
+            return version == t.version && float_size == t.float_size && layers == t.layers && activations == t.activations;
+        }
+
+        bool operator !=(const topology& t) const
+        {
+            return !(*this == t);
+        }
+
+        template <class Archive>
+        void serialize(Archive& ar)
+        {
+            ar(CEREAL_NVP(version), CEREAL_NVP(float_size), CEREAL_NVP(layers), CEREAL_NVP(activations));
+        }
+    private:
+        //policy of each weights layer, the same policy is repeated if network has single one
+        template <class Net, size_t ...I>
+        static std::vector<std::string> activation_ids(std::index_sequence<I...>)
+        {
+            return {Net::activations_t::template layer<I>::id()...};
+        }
+    };
+
+    enum class archive_format
+    {
+        binary,   ///native byte order, fastest
+        portable, ///little endian, can be loaded on any platform
+    };
+
+    ///writes weights of the network into file
+    template <class Net>
+    void save_model(const Net& net, const std::string& file_name, const archive_format format = archive_format::binary)
+    {
+        std::ofstream fs(file_name, std::ios::binary | std::ios::trunc);
+        if (!fs)
+            throw std::runtime_error("Cannot create file: " + file_name);
+        {
+            //archive must be destroyed before stream is checked, it may flush on destruction
+            if (format == archive_format::portable)
+            {
+                cereal::PortableBinaryOutputArchive ar(fs);
+                ar(net);
+            }
+            else
+            {
+                cereal::BinaryOutputArchive ar(fs);
+                ar(net);
+            }
+        }
+        fs.close();
+        if (fs.fail())
+            throw std::runtime_error("Failed to write model: " + file_name);
+    }
+
+    ///reads weights stored by save_model() with the same format, throws topology_mismatch if topology differs
+    template <class Net>
+    void load_model(Net& net, const std::string& file_name, const archive_format format = archive_format::binary)
+    {
+        std::ifstream fs(file_name, std::ios::binary);
+        if (!fs)
+            throw std::runtime_error("Cannot open file: " + file_name);
+
+        //loaded into copy, so net is untouched if file is broken
+        Net tmp;
+        try
+        {
+            if (format == archive_format::portable)
+            {
+                cereal::PortableBinaryInputArchive ar(fs);
+                ar(tmp);
+            }
+            else
+            {
+                cereal::BinaryInputArchive ar(fs);
+                ar(tmp);
+            }
+        }
+        catch (const cereal::Exception& e)
+        {
+            throw std::runtime_error("Failed to read model " + file_name + ": " + e.what());
+        }
+        net = std::move(tmp);
+    }
+}
+
+template <class Archive, class FloatOrConfig, size_t ...Args>
+void save(Archive& ar, const SimpleLayeredNN<FloatOrConfig, Args...>& net)
+{
+    const auto stored = nn::topology::of<SimpleLayeredNN<FloatOrConfig, Args...>>();
+    ar(cereal::make_nvp("topology", stored));
+    std::apply([&ar](const auto& ...w)
+    {
+        ar(w...);
+    }, net.layers_weights());
+}
+
+template <class Archive, class FloatOrConfig, size_t ...Args>
+void load(Archive& ar, SimpleLayeredNN<FloatOrConfig, Args...>& net)
+{
+    const auto expected = nn::topology::of<SimpleLayeredNN<FloatOrConfig, Args...>>();
+    nn::topology stored;
+    ar(cereal::make_nvp("topology", stored));
+    if (stored != expected)
+        throw nn::topology_mismatch("Stored network " + stored.to_string() + " does not match " + expected.to_string());
+
+    std::apply([&ar](auto& ...w)
+    {
+        ar(w...);
+    }, net.layers_weights());
+    net.sync_storage();
+}
+
+namespace nntest
+{
+    //saves network in format, loads it into another one and counts outputs which differ in any bit
+    //from outputs of the saved network (for inputs 0.1, 0.2, ...)
+    template <class Net>
+    inline size_t model_round_trip_mismatches(const nn::archive_format format)
+    {
+        const auto file = (std::filesystem::temp_directory_path() / "nntest_model.bin").string();
+        Net saved;
+        saved.random_weights(11);
+        nn::save_model(saved, file, format);
+        Net loaded;
+        nn::load_model(loaded, file, format);
+        std::filesystem::remove(file);
+
+        VectorRow<typename Net::Float, Net::inputs_count> inputs;
+        size_t mismatches = 0;
+        for (size_t k = 1; k <= 4; ++k)
+        {
+            for (size_t i = 0; i < inputs.size(); ++i)
+                inputs.data()[i] = static_cast<typename Net::Float>(0.1 * k * ((i % 7) + 1) / 7);
+            const auto a = saved.query(inputs);
+            const auto b = loaded.query(inputs);
+            for (size_t i = 0; i < a.size(); ++i)
+                mismatches += std::memcmp(a.data() + i, b.data() + i, sizeof(*a.data())) != 0;
+        }
+        return mismatches;
+    }
+
+    //true if network saved as Saved cannot be loaded into Loaded (topology_mismatch is thrown)
+    template <class Saved, class Loaded>
+    inline bool model_load_throws(const nn::archive_format format)
+    {
+        const auto file = (std::filesystem::temp_directory_path() / "nntest_model.bin").string();
+        Saved saved;
+        saved.random_weights(11);
+        nn::save_model(saved, file, format);
+        Loaded loaded;
+        bool thrown = false;
+        try
+        {
+            nn::load_model(loaded, file, format);
+        }
+        catch (const nn::topology_mismatch&)
+        {
+            thrown = true;
+        }
+        std::filesystem::remove(file);
+        return thrown;
+    }
+
+    //save -> load of both formats gives bit identical query(), networks of other layer sizes,
+    //float type or activations are not loaded
+    /*
+    Expecting result: 0
+    */
+    inline size_t model_round_trip()
+    {
+        using net_t   = SimpleLayeredNN<float, 20, 16, 5>;
+        using half_t  = SimpleLayeredNN<nn::config<float, nn::storage<fp::bf16>>, 20, 16, 5>;
+        using wide_t  = SimpleLayeredNN<float, 20, 17, 5>;
+        using dbl_t   = SimpleLayeredNN<double, 20, 16, 5>;
+        using tanh_t  = SimpleLayeredNN<nn::config<float, nn::activations<act::tanh>>, 20, 16, 5>;
+
+        size_t failed = 0;
+        for (const auto format : {nn::archive_format::binary, nn::archive_format::portable})
+        {
+            failed += model_round_trip_mismatches<net_t>(format);
+            failed += model_round_trip_mismatches<half_t>(format);
+            failed += !model_load_throws<net_t, wide_t>(format);
+            failed += !model_load_throws<net_t, dbl_t>(format);
+            failed += !model_load_throws<net_t, tanh_t>(format);
+        }
+        return failed;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+#include "vmath.h"
+#include "activations.h"
+#include "half.h"
+
+//compile time options of SimpleLayeredNN. First template parameter of the network is either
+//plain floating type or nn::config<Float, Options...>, options can be listed in any order:
+//  SimpleLayeredNN<nn::config<float, nn::precision<vmath::accuracy::fast>>, 784, 200, 10>
+//  SimpleLayeredNN<nn::config<float, nn::activations<act::relu, act::sigmoid>>, 784, 200, 10>
+//  SimpleLayeredNN<nn::config<float, nn::storage<fp::bf16>>, 784, 200, 10>
+//  SimpleLayeredNN<nn::config<float, nn::profiling<true>>, 784, 200, 10>
+namespace nn
+{
+    struct precision_tag {};
+    struct activations_tag {};
+    struct storage_tag {};
+    struct profiling_tag {};
+
+    ///accuracy of transcendental functions used by activations
+    template <vmath::accuracy A>
+    struct precision
+    {
+        using option_kind = precision_tag;
+        static constexpr vmath::accuracy value = A;
+    };
+
+    ///polynomials of vmath have float coefficients, so double network keeps libm unless it asks for them
+    template <class Float>
+    using default_precision = precision<std::is_same<Float, float>::value ? vmath::accuracy::high : vmath::accuracy::exact>;
+
+    ///activation policy per layer (see activations.h), first one is used by the first hidden layer
+    ///and the last one by the output layer. Single policy is used by all layers.
+    template <class ...Policies>
+    struct activations
+    {
+        static_assert(sizeof...(Policies) > 0, "At least 1 activation is expected.");
+        using option_kind = activations_tag;
+        static constexpr size_t count = sizeof...(Policies);
+
+        template <size_t Layer>
+        using layer = std::tuple_element_t<count == 1 ? 0 : Layer, std::tuple<Policies...>>;
+    };
+
+    using default_activations = activations<act::sigmoid>;
+
+    ///type weights are read from by single sample forward and backward passes: fp::bf16 or fp::f16
+    ///(float only). Weights are still kept in Float as master copy, which is updated by training
+    ///and used by batched passes, 16 bit copy is rounded from it.
+    ///Trained network without master copy (weights in 16 bits only, for serving) is half_nn (see half_nn.h).
+    template <class S>
+    struct storage
+    {
+        using option_kind = storage_tag;
+        using type = S;
+    };
+
+    //same as Float
+    using default_storage = storage<void>;
+
+    ///per phase time counters of train/query, readable by stats() of the network (see nn_stats.h)
+    template <bool Enabled>
+    struct profiling
+    {
+        using option_kind = profiling_tag;
+        static constexpr bool value = Enabled;
+    };
+
+    using default_profiling = profiling<false>;
+
+    template <class Float, class ...Options>
+    struct config
+    {
+    };
+
+    namespace details
+    {
+        //first option of the Kind or Default if there is none
+        template <class Kind, class Default, class ...Options>
+        struct find_option
+        {
+            using type = Default;
+        };
+
+        template <class Kind, class Default, class Option, class ...Options>
+        struct find_option<Kind, Default, Option, Options...>
+        {
+            using type = std::conditional_t<std::is_same<typename Option::option_kind, Kind>::value, Option,
+                                            typename find_option<Kind, Default, Options...>::type>;
+        };
+    }
+
+    template <class Float, class ...Options>
+    struct config_traits
+    {
+        static_assert(std::is_floating_point<Float>::value, "Expecting floating point type only.");
+        using float_t = Float;
+        static constexpr vmath::accuracy accuracy = details::find_option<precision_tag, default_precision<Float>, Options...>::type::value;
+        using activations_t = typename details::find_option<activations_tag, default_activations, Options...>::type;
+
+        static constexpr bool profiling = details::find_option<profiling_tag, default_profiling, Options...>::type::value;
+
+        using storage_option = typename details::find_option<storage_tag, default_storage, Options...>::type::type;
+        using storage_t = std::conditional_t<std::is_void<storage_option>::value, Float, storage_option>;
+        static_assert(std::is_same<storage_t, Float>::value || (std::is_same<Float, float>::value && fp::is_half_v<storage_t>),
+                      "16 bit storage is supported for float network only.");
+    };
+
+    template <class Float, class ...Options>
+    struct config_traits<config<Float, Options...>> : config_traits<Float, Options...>
+    {
+    };
+
+    static_assert(config_traits<float>::accuracy == vmath::accuracy::high, "Float network uses polynomials by default.");
+    static_assert(config_traits<double>::accuracy == vmath::accuracy::exact, "Double network uses libm by default.");
+}
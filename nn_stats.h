@@ -0,0 +1,319 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "cm_ctors.h"
+#include "palign.h"
+#include "parallel.h"
+
+//performance counters of SimpleLayeredNN, enabled by nn::profiling<true> option (see nn_config.h).
+//When disabled, recorder is empty and its scopes are empty objects, so nothing is measured.
+//Allocations and parallel tasks are taken from global counters, which exist only if NN_COUNTERS is 1
+//(see palign.h, parallel.h), they are 0 otherwise.
+namespace nn
+{
+    ///snapshot of counters, times are nanoseconds summed over all calls.
+    ///Allocations and parallel tasks are global counters sampled around calls, so work of other
+    ///threads done at the same time is included too.
+    template <size_t Layers>
+    struct stats
+    {
+        //per weights layer, 0 is the 1st layer after inputs, measured by training
+        std::array<uint64_t, Layers> forward_ns{};
+        std::array<uint64_t, Layers> backprop_ns{};
+        std::array<uint64_t, Layers> update_ns{};
+        //per weights layer, measured by query/query_batch
+        std::array<uint64_t, Layers> query_forward_ns{};
+
+        uint64_t train_ns{0};
+        uint64_t train_samples{0};
+        uint64_t query_ns{0};
+        uint64_t query_samples{0};
+
+        //done by AlignedAllocator (matrices, gemm buffers) during train/query
+        uint64_t allocations{0};
+        uint64_t bytes_allocated{0};
+        //chunks of loops run on parallel backend during train/query
+        uint64_t parallel_tasks{0};
+
+        double train_samples_per_second() const noexcept
+        {
+            return train_ns ? 1e9 * static_cast<double>(train_samples) / static_cast<double>(train_ns) : 0.0;
+        }
+
+        double query_samples_per_second() const noexcept
+        {
+            return query_ns ? 1e9 * static_cast<double>(query_samples) / static_cast<double>(query_ns) : 0.0;
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const stats& s)
+        {
+            const auto ms = [](const uint64_t ns)
+            {
+                return static_cast<double>(ns) * 1e-6;
+            };
+            os << "Train: " << s.train_samples << " samples, " << ms(s.train_ns) << " ms, "
+               << s.train_samples_per_second() << " samples/s" << std::endl;
+            for (size_t l = 0; l < Layers; ++l)
+                os << "  layer " << l << ": forward " << ms(s.forward_ns[l]) << " ms, backprop " << ms(s.backprop_ns[l])
+                   << " ms, update " << ms(s.update_ns[l]) << " ms" << std::endl;
+            os << "Query: " << s.query_samples << " samples, " << ms(s.query_ns) << " ms, "
+               << s.query_samples_per_second() << " samples/s" << std::endl;
+            for (size_t l = 0; l < Layers; ++l)
+                os << "  layer " << l << ": forward " << ms(s.query_forward_ns[l]) << " ms" << std::endl;
+            os
+               << "Allocations: " << s.allocations << " (" << s.bytes_allocated << " bytes), parallel tasks: "
+               << s.parallel_tasks << std::endl;
+            return os;
+        }
+    };
+
+    ///collects stats, counters are atomic, so network can be trained/queried by several threads
+    template <size_t Layers, bool Enabled>
+    class stats_recorder
+    {
+    private:
+        using clock = std::chrono::steady_clock;
+        using counter = std::atomic<uint64_t>;
+
+        std::array<counter, Layers> forward_ns{};
+        std::array<counter, Layers> backprop_ns{};
+        std::array<counter, Layers> update_ns{};
+        std::array<counter, Layers> query_forward_ns{};
+        counter train_ns{0};
+        counter train_samples{0};
+        counter query_ns{0};
+        counter query_samples{0};
+        counter allocations{0};
+        counter bytes_allocated{0};
+        counter parallel_tasks{0};
+
+        static uint64_t now() noexcept
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count());
+        }
+
+        static void add(counter& c, const uint64_t v) noexcept
+        {
+            c.fetch_add(v, std::memory_order_relaxed);
+        }
+
+        static uint64_t allocations_now() noexcept
+        {
+            if constexpr (AlignedAllocStats::enabled)
+                return AlignedAllocStats::allocations.load(std::memory_order_relaxed);
+            return 0;
+        }
+
+        static uint64_t bytes_now() noexcept
+        {
+            if constexpr (AlignedAllocStats::enabled)
+                return AlignedAllocStats::bytes.load(std::memory_order_relaxed);
+            return 0;
+        }
+
+        static uint64_t tasks_now() noexcept
+        {
+            if constexpr (par::stats::enabled)
+                return par::stats::tasks.load(std::memory_order_relaxed);
+            return 0;
+        }
+    public:
+        ///adds time of own life into counter
+        class phase
+        {
+        private:
+            counter& dst;
+            const uint64_t start{now()};
+        public:
+            explicit phase(counter& dst) noexcept :
+                dst(dst)
+            {
+            }
+
+            NO_COPYMOVE(phase);
+
+            ~phase()
+            {
+                add(dst, now() - start);
+            }
+        };
+
+        ///whole train/query call: time, samples, allocations and tasks done meanwhile
+        class call
+        {
+        private:
+            counter& time;
+            stats_recorder& owner;
+            const uint64_t allocs{allocations_now()};
+            const uint64_t bytes{bytes_now()};
+            const uint64_t tasks{tasks_now()};
+            const uint64_t start{now()};
+        public:
+            call(counter& time, counter& samples, const uint64_t count, stats_recorder& owner) noexcept :
+                time(time),
+                owner(owner)
+            {
+                add(samples, count);
+            }
+
+            NO_COPYMOVE(call);
+
+            ~call()
+            {
+                add(time, now() - start);
+                if constexpr (AlignedAllocStats::enabled)
+                {
+                    add(owner.allocations, allocations_now() - allocs);
+                    add(owner.bytes_allocated, bytes_now() - bytes);
+                }
+                if constexpr (par::stats::enabled)
+                    add(owner.parallel_tasks, tasks_now() - tasks);
+            }
+        };
+
+        stats_recorder() = default;
+        ~stats_recorder() = default;
+
+        //copy of network gets copy of its counters
+        stats_recorder(const stats_recorder& other) noexcept
+        {
+            *this = other;
+        }
+
+        stats_recorder& operator=(const stats_recorder& other) noexcept
+        {
+            if (this != &other)
+                load(other.snapshot());
+            return *this;
+        }
+
+        phase forward(const size_t layer) noexcept
+        {
+            return phase(forward_ns[layer]);
+        }
+
+        phase backprop(const size_t layer) noexcept
+        {
+            return phase(backprop_ns[layer]);
+        }
+
+        phase update(const size_t layer) noexcept
+        {
+            return phase(update_ns[layer]);
+        }
+
+        phase query_forward(const size_t layer) noexcept
+        {
+            return phase(query_forward_ns[layer]);
+        }
+
+        call train(const uint64_t samples) noexcept
+        {
+            return call(train_ns, train_samples, samples, *this);
+        }
+
+        call query(const uint64_t samples) noexcept
+        {
+            return call(query_ns, query_samples, samples, *this);
+        }
+
+        stats<Layers> snapshot() const noexcept
+        {
+            stats<Layers> s;
+            for (size_t l = 0; l < Layers; ++l)
+            {
+                s.forward_ns[l]  = forward_ns[l].load(std::memory_order_relaxed);
+                s.backprop_ns[l] = backprop_ns[l].load(std::memory_order_relaxed);
+                s.update_ns[l]   = update_ns[l].load(std::memory_order_relaxed);
+                s.query_forward_ns[l] = query_forward_ns[l].load(std::memory_order_relaxed);
+            }
+            s.train_ns        = train_ns.load(std::memory_order_relaxed);
+            s.train_samples   = train_samples.load(std::memory_order_relaxed);
+            s.query_ns        = query_ns.load(std::memory_order_relaxed);
+            s.query_samples   = query_samples.load(std::memory_order_relaxed);
+            s.allocations     = allocations.load(std::memory_order_relaxed);
+            s.bytes_allocated = bytes_allocated.load(std::memory_order_relaxed);
+            s.parallel_tasks  = parallel_tasks.load(std::memory_order_relaxed);
+            return s;
+        }
+
+        void reset() noexcept
+        {
+            load(stats<Layers>{});
+        }
+    private:
+        void load(const stats<Layers>& s) noexcept
+        {
+            for (size_t l = 0; l < Layers; ++l)
+            {
+                forward_ns[l].store(s.forward_ns[l], std::memory_order_relaxed);
+                backprop_ns[l].store(s.backprop_ns[l], std::memory_order_relaxed);
+                update_ns[l].store(s.update_ns[l], std::memory_order_relaxed);
+                query_forward_ns[l].store(s.query_forward_ns[l], std::memory_order_relaxed);
+            }
+            train_ns.store(s.train_ns, std::memory_order_relaxed);
+            train_samples.store(s.train_samples, std::memory_order_relaxed);
+            query_ns.store(s.query_ns, std::memory_order_relaxed);
+            query_samples.store(s.query_samples, std::memory_order_relaxed);
+            allocations.store(s.allocations, std::memory_order_relaxed);
+            bytes_allocated.store(s.bytes_allocated, std::memory_order_relaxed);
+            parallel_tasks.store(s.parallel_tasks, std::memory_order_relaxed);
+        }
+    };
+
+    ///profiling disabled: same interface, nothing is stored or measured
+    template <size_t Layers>
+    class stats_recorder<Layers, false>
+    {
+    public:
+        struct phase
+        {
+        };
+
+        using call = phase;
+
+        static phase forward(const size_t) noexcept
+        {
+            return {};
+        }
+
+        static phase backprop(const size_t) noexcept
+        {
+            return {};
+        }
+
+        static phase update(const size_t) noexcept
+        {
+            return {};
+        }
+
+        static phase query_forward(const size_t) noexcept
+        {
+            return {};
+        }
+
+        static call train(const uint64_t) noexcept
+        {
+            return {};
+        }
+
+        static call query(const uint64_t) noexcept
+        {
+            return {};
+        }
+
+        static stats<Layers> snapshot() noexcept
+        {
+            return {};
+        }
+
+        static void reset() noexcept
+        {
+        }
+    };
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include "cm_ctors.h"
+#include "runners.h"
+#include "parallel.h"
+#include "rnd_nn.h"
+#include "simple_nn.h"
+
+///data-parallel training of SimpleLayeredNN: samples of epoch are split into contiguous shards,
+///1 shard per worker thread, workers are team of utility::thread_pool::global() (calling thread is 1 of them,
+///so there are at most size() + 1 workers). Loops inside of training step run on worker's own thread.
+///Modes:
+/// - sharded: each worker trains own copy of weights, every sync_period samples (of all workers together)
+///   updates of the copies are summed into the network and workers continue from the result, so round acts
+///   as sequential SGD over its samples. Result depends on threads count, but not on scheduling.
+/// - hogwild: all workers update weights of the network directly without any locks. Updates of
+///   different threads may overwrite each other, that is accepted (see Hogwild! paper).
+///   Each update is dense (whole weights matrix), so collisions are frequent when layers are small.
+template <class Net>
+class parallel_trainer
+{
+public:
+    using Float = typename Net::Float;
+
+    enum class mode
+    {
+        sharded,
+        hogwild,
+    };
+
+    explicit parallel_trainer(Net& net, const mode m = mode::sharded, const size_t threads = 0,
+                              const size_t sync_period = 64) :
+        net(net),
+        work_mode(m),
+        workers(std::min(threads ? threads : std::max(1u, std::thread::hardware_concurrency()),
+                         utility::thread_pool::global().size() + 1)),
+        sync_period(std::max<size_t>(1, sync_period))
+    {
+        if (work_mode == mode::sharded)
+            replicas.resize(workers);
+    }
+
+    NO_COPYMOVE(parallel_trainer);
+    ~parallel_trainer() = default;
+
+    ///workers really used, requested threads are limited by size of the pool
+    size_t threads() const noexcept
+    {
+        return workers;
+    }
+
+    ///trains 1 epoch over [first, last), sample is pair-like (inputs, targets) as for train_batch().
+    ///Each worker trains its shard by batches of Batch samples (Batch = 1 is plain SGD)
+    template <size_t Batch = 1, class Iter>
+    void train_epoch(const Float learning_rate, Iter first, Iter last)
+    {
+        static_assert(Batch > 0, "Empty batch.");
+        const size_t total = static_cast<size_t>(std::distance(first, last));
+        const size_t n = std::min(workers, std::max<size_t>(1, total));
+
+        //shard w is [shard_begin(w), shard_begin(w + 1))
+        const auto shard_begin = [total, n](const size_t w)
+        {
+            return total * w / n;
+        };
+
+        if (work_mode == mode::hogwild)
+        {
+            run_workers(n, [&](const size_t w)
+            {
+                train_range<Batch>(net, learning_rate, std::next(first, shard_begin(w)), shard_begin(w + 1) - shard_begin(w));
+            });
+            return;
+        }
+
+        //rounds of sync_period samples of all workers (at least 1 batch per worker), the last round may be incomplete
+        const size_t longest = (total + n - 1) / n;
+        const size_t period  = std::max(Batch, sync_period / n);
+        const size_t rounds  = (longest + period - 1) / period;
+        utility::barrier sync(n);
+
+        run_workers(n, [&](const size_t w)
+        {
+            auto& local = replicas.at(w);
+            local = net;
+
+            const size_t from = shard_begin(w);
+            const size_t to   = shard_begin(w + 1);
+            for (size_t r = 0; r < rounds; ++r)
+            {
+                const size_t rf = std::min(to, from + r * period);
+                const size_t rt = std::min(to, rf + period);
+                train_range<Batch>(local, learning_rate, std::next(first, rf), rt - rf);
+
+                sync.wait();
+                merge_slice(w, n);
+                sync.wait();
+                if (r + 1 < rounds)
+                {
+                    local.layers_weights() = net.layers_weights();
+                    local.sync_storage();
+                }
+            }
+        });
+        net.sync_storage();
+    }
+
+    template <size_t Batch = 1, class Container>
+    void train_epoch(const Float learning_rate, const Container& samples)
+    {
+        train_epoch<Batch>(learning_rate, std::begin(samples), std::end(samples));
+    }
+private:
+    Net& net;
+    const mode work_mode;
+    const size_t workers;
+    const size_t sync_period;
+
+    //private copies of the network for sharded mode, 1 per worker
+    std::vector<Net> replicas;
+
+    //n is limited by constructor to the pool size + 1. Team occupies the pool, so loops of members
+    //run sequentially instead of queueing chunks to threads which wait on barrier
+    template <class F>
+    static void run_workers(const size_t n, F&& f)
+    {
+        utility::thread_pool::global().run_team(n, [&f](const size_t w)
+        {
+            const par::sequential_scope own_thread;
+            f(w);
+        });
+    }
+
+    template <size_t Batch, class Target, class Iter>
+    static void train_range(Target& target, const Float learning_rate, Iter it, const size_t count)
+    {
+        size_t i = 0;
+        if constexpr (Batch > 1)
+        {
+            typename Net::template workspace<Batch> ws;
+            for (; i + Batch <= count; i += Batch, std::advance(it, Batch))
+                target.template train_batch<Batch>(ws, learning_rate, it);
+        }
+
+        //the rest which does not fill whole batch, samples are stacked by train_batch(),
+        //so any sample type with first/second readable by at(r, 0) is accepted
+        typename Net::template workspace<1> ws;
+        for (; i < count; ++i, ++it)
+            target.template train_batch<1>(ws, learning_rate, it);
+    }
+
+    //net += sum of (replica - net), worker w does elements [size * w / n, size * (w + 1) / n) of each matrix.
+    //Average of replicas would divide learning rate by n, as each replica sees 1/n of samples
+    void merge_slice(const size_t w, const size_t n)
+    {
+        merge_slice(w, n, std::make_index_sequence<std::tuple_size<std::decay_t<decltype(net.layers_weights())>>::value>());
+    }
+
+    template <size_t ...I>
+    void merge_slice(const size_t w, const size_t n, std::index_sequence<I...>)
+    {
+        const auto layer = [&](auto index)
+        {
+            constexpr size_t L = decltype(index)::value;
+            auto& dst = std::get<L>(net.layers_weights());
+            const size_t size = dst.size();
+            const size_t from = size * w / n;
+            const size_t to   = size * (w + 1) / n;
+
+            for (size_t i = from; i < to; ++i)
+            {
+                const Float base = dst.data()[i];
+                Float sum = 0;
+                for (size_t k = 0; k < n; ++k)
+                    sum += std::get<L>(replicas[k].layers_weights()).data()[i] - base;
+                dst.data()[i] = base + sum;
+            }
+        };
+        (layer(std::integral_constant<size_t, I>{}), ...);
+    }
+};
+
+namespace nntest
+{
+    //trainings of synthetic 4 classes problem which recognize less than 95% of training samples after 5 epochs:
+    //sequential train() as reference, parallel_trainer sharded (4 and default threads) and hogwild
+    /*
+    Expecting result: 0
+    */
+    inline size_t parallel_trainer_failures()
+    {
+        using nn_t     = SimpleLayeredNN<float, 32, 24, 4>;
+        using sample_t = std::pair<VectorRow<float, 32>, VectorRow<float, 4>>;
+
+        //class k lights inputs i with i % 4 == k, all inputs get noise
+        std::vector<sample_t> samples(256);
+        for (size_t s = 0; s < samples.size(); ++s)
+        {
+            const size_t k = s % 4;
+            for (size_t i = 0; i < 32; i += 4)
+            {
+                const auto w = rnd_nn::philox4x32::generate(77, s, i);
+                for (size_t j = 0; j < 4; ++j)
+                    samples[s].first.at(i + j, 0) = (j == k ? 0.5f : 0.2f) + 0.5f * static_cast<float>(w[j] >> 8) / 16777216.f;
+            }
+            for (size_t j = 0; j < 4; ++j)
+                samples[s].second.at(j, 0) = j == k ? 0.99f : 0.01f;
+        }
+
+        const auto recognized = [&samples](const nn_t& nn)
+        {
+            size_t res = 0;
+            for (const auto& s : samples)
+            {
+                const auto out = nn.query(s.first);
+                res += std::max_element(out.begin(), out.end()) - out.begin()
+                       == std::max_element(s.second.begin(), s.second.end()) - s.second.begin();
+            }
+            return res;
+        };
+
+        constexpr size_t epochs = 5;
+        constexpr float rate    = 0.3f;
+        const size_t needed     = samples.size() * 95 / 100;
+        size_t failures = 0;
+
+        nn_t sequential;
+        sequential.random_weights(3);
+        for (size_t e = 0; e < epochs; ++e)
+            for (const auto& s : samples)
+                sequential.train(rate, s.first, s.second);
+        failures += recognized(sequential) < needed;
+
+        using trainer_t = parallel_trainer<nn_t>;
+        const auto parallel = [&](const typename trainer_t::mode m, const size_t threads)
+        {
+            nn_t nn;
+            nn.random_weights(3);
+            trainer_t trainer(nn, m, threads, 16);
+            for (size_t e = 0; e < epochs; ++e)
+                trainer.template train_epoch<4>(rate, samples);
+            return recognized(nn) >= needed;
+        };
+        failures += !parallel(trainer_t::mode::sharded, 4);
+        failures += !parallel(trainer_t::mode::sharded, 0);
+        failures += !parallel(trainer_t::mode::hogwild, 4);
+        return failures;
+    }
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <tuple>
+#include <cmath>
+#include <utility>
+#include <iterator>
+#include <ostream>
+#include <algorithm>
+
+#include "cm_ctors.h"
+#include "matrix2d.h"
+#include "parallel.h"
+#include "quant.h"
+
+///inference-only copy of trained SimpleLayeredNN with int8 weights.
+///Each weights row (1 neuron) has own scale, inputs of each layer are quantized per sample,
+///products are accumulated in int32 and scaled back to Float before activation.
+///Weights take 4x less memory than float ones, so single sample query streams 4x less.
+template <class Net>
+class quantized_nn
+{
+public:
+    using Float = typename Net::Float;
+
+    static constexpr size_t layers_count  = Net::layers_count;
+    static constexpr size_t inputs_count  = Net::inputs_count;
+    static constexpr size_t outputs_count = Net::outputs_count;
+
+    explicit quantized_nn(const Net& net)
+    {
+        quantize_layers(net, std::make_index_sequence<layers_count - 1>());
+    }
+
+    ~quantized_nn() = default;
+    DEFAULT_COPYMOVE(quantized_nn);
+
+    ///single sample, outputs receive outputs_count values
+    void query(const Float* inputs, Float* outputs) const noexcept
+    {
+        forward(inputs, outputs, std::make_index_sequence<layers_count - 1>());
+    }
+
+    VectorRow<Float, outputs_count> query(const VectorRow<Float, inputs_count>& inputs) const noexcept
+    {
+        VectorRow<Float, outputs_count> res;
+        query(inputs.data(), res.data());
+        return res;
+    }
+
+    ///count samples stored one after another, as SimpleLayeredNN::query_batch() takes them
+    void query_batch(const Float* inputs, const size_t count, Float* outputs) const
+    {
+        constexpr size_t grain = 64;
+        par::for_chunks(count, grain, [&](const size_t from, const size_t to)
+        {
+            for (size_t s = from; s < to; ++s)
+                query(inputs + s * inputs_count, outputs + s * outputs_count);
+        });
+    }
+
+    ///bytes taken by quantized weights and their scales
+    size_t weights_bytes() const noexcept
+    {
+        size_t bytes = 0;
+        for (const auto& l : layers)
+            bytes += l.weights.size() + l.scales.size() * sizeof(float);
+        return bytes;
+    }
+private:
+    struct layer
+    {
+        size_t rows{0};
+        size_t cols{0};
+        //row length padded by zeros to quant::block
+        size_t stride{0};
+        AlignedVector<int8_t, quant::block> weights;
+        std::vector<float> scales;
+    };
+
+    std::array<layer, layers_count - 1> layers;
+
+    static constexpr size_t max_width()
+    {
+        size_t m = 0;
+        for (const size_t s : Net::layer_sizes)
+            m = std::max(m, s);
+        return m;
+    }
+
+    template <size_t ...I>
+    void quantize_layers(const Net& net, std::index_sequence<I...>)
+    {
+        (quantize_layer(std::get<I>(net.layers_weights()), layers[I]), ...);
+    }
+
+    template <class Matrix>
+    static void quantize_layer(const Matrix& wm, layer& dst)
+    {
+        dst.rows   = wm.rows();
+        dst.cols   = wm.cols();
+        dst.stride = quant::padded(dst.cols);
+        dst.weights.resize(dst.rows * dst.stride);
+        dst.scales.resize(dst.rows);
+
+        for (size_t r = 0; r < dst.rows; ++r)
+        {
+            const Float* row = wm.data() + r * dst.cols;
+            dst.scales[r] = quant::scale_of(row, dst.cols);
+            quant::quantize(row, dst.cols, dst.scales[r], dst.weights.data() + r * dst.stride);
+        }
+    }
+
+    template <size_t ...I>
+    void forward(const Float* inputs, Float* outputs, std::index_sequence<I...>) const noexcept
+    {
+        alignas(quant::block) std::array<int8_t, quant::padded(max_width())> q;
+        std::array<Float, max_width()> ping;
+        std::array<Float, max_width()> pong;
+
+        const Float* src = inputs;
+        const auto step = [&](auto index)
+        {
+            constexpr size_t L = decltype(index)::value;
+            Float* dst = L == layers_count - 2 ? outputs : (src == ping.data() ? pong.data() : ping.data());
+            forward_layer<L>(src, q.data(), dst);
+            src = dst;
+        };
+        (step(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    template <size_t L>
+    void forward_layer(const Float* src, int8_t* q, Float* dst) const noexcept
+    {
+        const layer& l = layers[L];
+        const float in_scale = quant::scale_of(src, l.cols);
+        quant::quantize(src, l.cols, in_scale, q);
+
+        for (size_t r = 0; r < l.rows; ++r)
+        {
+            const int32_t acc = quant::dot(l.weights.data() + r * l.stride, q, l.stride);
+            dst[r] = static_cast<Float>(static_cast<float>(acc) * (l.scales[r] * in_scale));
+        }
+
+        using policy_t = typename Net::activations_t::template layer<L>;
+        policy_t::template forward<Net::accuracy>(dst, dst, l.rows);
+    }
+};
+
+///comparison of quantized network with the float one it was built from
+struct quantization_report
+{
+    size_t samples{0};
+    //argmax of both outputs is the same
+    size_t agree{0};
+    //argmax of outputs matches argmax of target
+    size_t float_correct{0};
+    size_t quant_correct{0};
+    double max_abs_error{0};
+    double mean_abs_error{0};
+    size_t float_bytes{0};
+    size_t quant_bytes{0};
+
+    ///samples are pair-like (inputs, targets) as mnist_loader::train_value
+    template <class Net, class Iter>
+    static quantization_report compare(const Net& net, const quantized_nn<Net>& qnet, Iter first, Iter last)
+    {
+        quantization_report r;
+        std::apply([&r](const auto& ...w)
+        {
+            r.float_bytes = ((w.size() * sizeof(typename Net::Float)) + ...);
+        }, net.layers_weights());
+        r.quant_bytes = qnet.weights_bytes();
+
+        double sum = 0;
+        for (; first != last; ++first)
+        {
+            const auto& sample = *first;
+            const auto f = net.query(sample.first);
+            const auto q = qnet.query(sample.first);
+
+            const auto fmax = std::distance(f.begin(), std::max_element(f.begin(), f.end()));
+            const auto qmax = std::distance(q.begin(), std::max_element(q.begin(), q.end()));
+            const auto tmax = std::distance(sample.second.begin(), std::max_element(sample.second.begin(), sample.second.end()));
+            r.agree         += fmax == qmax;
+            r.float_correct += fmax == tmax;
+            r.quant_correct += qmax == tmax;
+
+            for (size_t i = 0; i < f.size(); ++i)
+            {
+                const double e = std::fabs(static_cast<double>(f.data()[i]) - static_cast<double>(q.data()[i]));
+                r.max_abs_error = std::max(r.max_abs_error, e);
+                sum += e;
+            }
+            r.samples++;
+        }
+        if (r.samples)
+            r.mean_abs_error = sum / static_cast<double>(r.samples * Net::outputs_count);
+        return r;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const quantization_report& r)
+    {
+        const auto pct = [&r](const size_t v)
+        {
+            return r.samples ? 100.0 * static_cast<double>(v) / static_cast<double>(r.samples) : 0.0;
+        };
+        os << "Samples: " << r.samples << std::endl
+           << "Float accuracy: " << pct(r.float_correct) << "%, int8 accuracy: " << pct(r.quant_correct) << "%" << std::endl
+           << "Same answer: " << pct(r.agree) << "%" << std::endl
+           << "Output error max: " << r.max_abs_error << ", mean: " << r.mean_abs_error << std::endl
+           << "Weights bytes float: " << r.float_bytes << ", int8: " << r.quant_bytes << std::endl;
+        return os;
+    }
+};
@@ -1,52 +1,455 @@
 #pragma once
 
-#include <Eigen/Dense>
 #include <algorithm>
 #include <type_traits>
 #include <random>
 #include <tuple>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <numeric>
+#include <thread>
 
+#include "parallel.h"
+#include "vmath.h"
+
+//Counter-based random numbers (Philox4x32-10, Salmon et al. "Parallel random numbers: as easy as 1, 2, 3").
+//Value is pure function of (seed, stream, index), there is no state to share between threads,
+//so big fills are split into chunks freely and result does not depend on amount of threads.
 namespace rnd_nn
 {
+    ///Philox4x32 with 10 rounds: 128 bits counter and 64 bits key give 4 random 32 bits words
+    struct philox4x32
+    {
+        using block_t = std::array<std::uint32_t, 4>;
+
+        static block_t generate(block_t ctr, std::uint32_t k0, std::uint32_t k1) noexcept
+        {
+            for (int r = 0; r < 10; ++r)
+            {
+                const std::uint64_t p0 = std::uint64_t{0xD2511F53u} * ctr[0];
+                const std::uint64_t p1 = std::uint64_t{0xCD9E8D57u} * ctr[2];
+                ctr = {static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ k0, static_cast<std::uint32_t>(p1),
+                       static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ k1, static_cast<std::uint32_t>(p0)};
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+            return ctr;
+        }
+
+        ///block number index of the stream, seed is the key
+        static block_t generate(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t index) noexcept
+        {
+            return generate({static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(index >> 32),
+                             static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)},
+                            static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32));
+        }
+    };
+
+    ///seed used when caller does not give own one, set it once at start to make whole run reproducible,
+    ///by default it is taken from real entropy
+    inline std::atomic<std::uint64_t>& master_seed() noexcept
+    {
+        static std::atomic<std::uint64_t> seed((std::uint64_t{std::random_device{}()} << 32) ^ std::random_device{}());
+        return seed;
+    }
+
+    ///sequential generator over 1 stream, satisfies UniformRandomBitGenerator (usable with std:: distributions
+    ///and std::shuffle), copy continues the same sequence independently
+    class counter_rng
+    {
+    public:
+        using result_type = std::uint32_t;
+
+        explicit counter_rng(const std::uint64_t seed = master_seed().load(), const std::uint64_t stream = 0) noexcept :
+            seed(seed),
+            stream(stream)
+        {
+        }
+
+        static constexpr result_type min() noexcept
+        {
+            return 0;
+        }
+
+        static constexpr result_type max() noexcept
+        {
+            return std::numeric_limits<result_type>::max();
+        }
+
+        result_type operator()() noexcept
+        {
+            if (used == buffer.size())
+            {
+                buffer = philox4x32::generate(seed, stream, block++);
+                used = 0;
+            }
+            return buffer[used++];
+        }
+
+        ///jumps to the word index of the stream
+        void seek(const std::uint64_t index) noexcept
+        {
+            block = index / 4;
+            buffer = philox4x32::generate(seed, stream, block++);
+            used = static_cast<size_t>(index % 4);
+        }
+
+        ///generator of another stream with the same seed, streams do not overlap
+        counter_rng split(const std::uint64_t other_stream) const noexcept
+        {
+            return counter_rng(seed, other_stream);
+        }
+    private:
+        std::uint64_t seed;
+        std::uint64_t stream;
+        std::uint64_t block{0};
+        philox4x32::block_t buffer{};
+        size_t used{4};
+    };
+
+    namespace details
+    {
+        //elements generated together: first half is r * cos, second half is r * sin of the same pairs (Box-Muller),
+        //fixed size, so values do not depend on width of the SIMD pack either
+        constexpr size_t normal_batch = 32;
+        constexpr size_t words_per_batch = normal_batch / 4;
+
+        //chunks of parallel fill, multiple of normal_batch
+        constexpr size_t fill_grain = 16384;
+
+        //uniform value in (0; 1], 24 bits are exact in float
+        template <class Float>
+        inline Float to_unit(const std::uint32_t w) noexcept
+        {
+            return static_cast<Float>((w >> 8) + 1) * static_cast<Float>(1.0 / 16777216.0);
+        }
+
+        template <class Float>
+        inline void uniform_words(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t batch,
+                                  Float* dst) noexcept
+        {
+            for (size_t b = 0; b < words_per_batch; ++b)
+            {
+                const auto w = philox4x32::generate(seed, stream, batch * words_per_batch + b);
+                for (size_t j = 0; j < 4; ++j)
+                    dst[b * 4 + j] = to_unit<Float>(w[j]);
+            }
+        }
+
+        //normal_batch values of N(mean, sdev) into dst
+        template <class Float>
+        inline void normal_batch_at(const std::uint64_t seed, const std::uint64_t stream, const std::uint64_t batch,
+                                    const Float mean, const Float sdev, Float* dst) noexcept
+        {
+            using P = vmath::details::vec_t<Float>;
+            static_assert((normal_batch / 2) % P::width == 0, "Half of batch must be split into whole packs.");
+            constexpr size_t half = normal_batch / 2;
+
+            alignas(64) Float u[normal_batch];
+            uniform_words(seed, stream, batch, u);
+
+            for (size_t i = 0; i < half; i += P::width)
+            {
+                const P u1 = P::loadu(u + i);
+                const P u2 = P::loadu(u + half + i);
+                const P r  = sqrt(P::set1(-2.f) * vmath::details::log<vmath::accuracy::high, Float>(u1)) * P::set1(sdev);
+                const P m  = P::set1(mean);
+                fma(r, vmath::details::cos_2pi(u2), m).storeu(dst + i);
+                fma(r, vmath::details::cos_2pi(u2 - P::set1(0.25f)), m).storeu(dst + half + i);
+            }
+        }
+
+        //calls f(batch, dst, count) for each batch of [0, count), batches are distributed over threads
+        template <class Float, class F>
+        inline void for_batches(Float* dst, const size_t count, F&& f)
+        {
+            par::for_chunks(count, fill_grain, [&f, dst](const size_t from, const size_t to)
+            {
+                for (size_t i = from; i < to; i += normal_batch)
+                    f(i / normal_batch, dst + i, std::min(normal_batch, to - i));
+            });
+        }
+    }
+
+    ///dst[i] is normal value N(mean, sdev), which depends on (seed, stream, i) only
+    template <class Float>
+    void fill_normal(Float* dst, const size_t count, const Float mean, const Float sdev,
+                     const std::uint64_t seed = master_seed().load(), const std::uint64_t stream = 0)
+    {
+        static_assert(std::is_floating_point<Float>::value, "Floating point type expected.");
+        details::for_batches(dst, count, [seed, stream, mean, sdev](const size_t batch, Float* out, const size_t n)
+        {
+            if (n == details::normal_batch)
+                details::normal_batch_at(seed, stream, batch, mean, sdev, out);
+            else
+            {
+                Float tmp[details::normal_batch];
+                details::normal_batch_at(seed, stream, batch, mean, sdev, tmp);
+                std::copy(tmp, tmp + n, out);
+            }
+        });
+    }
+
+    ///dst[i] is uniform value in (from; to], which depends on (seed, stream, i) only
+    template <class Float>
+    void fill_uniform(Float* dst, const size_t count, const Float from, const Float to,
+                      const std::uint64_t seed = master_seed().load(), const std::uint64_t stream = 0)
+    {
+        static_assert(std::is_floating_point<Float>::value, "Floating point type expected.");
+        details::for_batches(dst, count, [seed, stream, from, to](const size_t batch, Float* out, const size_t n)
+        {
+            Float tmp[details::normal_batch];
+            details::uniform_words(seed, stream, batch, tmp);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = from + (to - from) * tmp[i];
+        });
+    }
+
+    ///random permutation of [0, count): index gets random key (generated in parallel) and indexes are ordered by keys,
+    ///so result depends on (seed, stream) only. Key is random high bits with index in low bits, so keys are unique.
+    ///Ordering is 1 pass of MSD radix (stable scatter into buckets by top bits), then small buckets are sorted in parallel.
+    inline std::vector<size_t> permutation(const size_t count, const std::uint64_t seed = master_seed().load(),
+                                           const std::uint64_t stream = 0)
+    {
+        int index_bits = 0;
+        while (index_bits < 64 && (count - 1) >> index_bits > 0)
+            ++index_bits;
+        const std::uint64_t index_mask = index_bits < 64 ? (std::uint64_t{1} << index_bits) - 1 : ~std::uint64_t{0};
+
+        std::vector<std::uint64_t> keys(count);
+        par::for_chunks(count, details::fill_grain, [&keys, seed, stream, index_mask](const size_t from, const size_t to)
+        {
+            for (size_t i = from; i < to; ++i)
+            {
+                //2 keys per block
+                const auto w = philox4x32::generate(seed, stream, i / 2);
+                const size_t h = (i % 2) * 2;
+                keys[i] = (((std::uint64_t{w[h]} << 32) | w[h + 1]) & ~index_mask) | i;
+            }
+        });
+
+        //about 64 keys per bucket
+        int bits = 0;
+        while (bits < 20 && (count >> (bits + 6)) > 0)
+            ++bits;
+        const int shift = 64 - bits;
+        const auto bucket = [shift](const std::uint64_t k)
+        {
+            return shift < 64 ? static_cast<size_t>(k >> shift) : size_t{0};
+        };
+
+        std::vector<size_t> starts((size_t{1} << bits) + 1, 0);
+        for (const auto k : keys)
+            ++starts[bucket(k) + 1];
+        std::partial_sum(starts.begin(), starts.end(), starts.begin());
+
+        std::vector<std::uint64_t> sorted(count);
+        std::vector<size_t> pos(starts.begin(), starts.end() - 1);
+        for (const auto k : keys)
+            sorted[pos[bucket(k)]++] = k;
+
+        std::vector<size_t> res(count);
+        par::for_chunks(starts.size() - 1, 1024, [&res, &sorted, &starts, index_mask](const size_t from, const size_t to)
+        {
+            for (size_t b = from; b < to; ++b)
+            {
+                std::sort(sorted.begin() + static_cast<std::ptrdiff_t>(starts[b]),
+                          sorted.begin() + static_cast<std::ptrdiff_t>(starts[b + 1]));
+                for (size_t i = starts[b]; i < starts[b + 1]; ++i)
+                    res[i] = static_cast<size_t>(sorted[i] & index_mask);
+            }
+        });
+        return res;
+    }
+
+    ///random bijection of [0, count) without table: operator()(i) is pure function of (seed, stream, i), so any thread
+    ///can take any position of random order at any time. Balanced Feistel network over the smallest 2^(2h) >= count,
+    ///value outside of [0, count) is mapped again (cycle walking) until it gets inside, less than 4 times on average.
+    class bijection
+    {
+    public:
+        explicit bijection(const size_t count, const std::uint64_t seed = master_seed().load(), const std::uint64_t stream = 0) noexcept :
+            count(count)
+        {
+            while (half_bits < 32 && (std::uint64_t{1} << (2 * half_bits)) < count)
+                ++half_bits;
+            half_mask = (std::uint64_t{1} << half_bits) - 1;
+            for (size_t r = 0; r < rounds; r += 2)
+            {
+                const auto w = philox4x32::generate(seed, stream, r / 2);
+                keys[r]     = (std::uint64_t{w[0]} << 32) | w[1];
+                keys[r + 1] = (std::uint64_t{w[2]} << 32) | w[3];
+            }
+        }
+
+        size_t size() const noexcept
+        {
+            return count;
+        }
+
+        ///position i of random order, i < size()
+        size_t operator()(const size_t i) const noexcept
+        {
+            std::uint64_t x = i;
+            do
+                x = permute(x);
+            while (x >= count);
+            return static_cast<size_t>(x);
+        }
+    private:
+        static constexpr size_t rounds = 6;
+
+        std::uint64_t count;
+        int half_bits{0};
+        std::uint64_t half_mask{0};
+        std::array<std::uint64_t, rounds> keys{};
+
+        //one to one over [0, 2^(2 * half_bits))
+        std::uint64_t permute(const std::uint64_t x) const noexcept
+        {
+            std::uint64_t l = x >> half_bits;
+            std::uint64_t r = x & half_mask;
+            for (const auto k : keys)
+            {
+                const std::uint64_t f = mix(r ^ k) & half_mask;
+                const std::uint64_t t = r;
+                r = l ^ f;
+                l = t;
+            }
+            return (l << half_bits) | r;
+        }
+
+        //finalizer of MurmurHash3, each input bit affects all output bits
+        static std::uint64_t mix(std::uint64_t v) noexcept
+        {
+            v ^= v >> 33;
+            v *= 0xFF51AFD7ED558CCDull;
+            v ^= v >> 33;
+            v *= 0xC4CEB9FE1A85EC53ull;
+            return v ^ (v >> 33);
+        }
+    };
+
+    ///streams with this bit belong to gen(), streams given by callers (layer index of weights, 0 by default)
+    ///are small numbers, so gen() never repeats blocks of the same master_seed() used elsewhere
+    constexpr std::uint64_t gen_streams = std::uint64_t{1} << 63;
+
+    ///uniform value in [0.1; 0.7), as NN does not like 0 and 1. Each thread has own stream of master_seed()
+    ///(see gen_streams), so it is safe to call from any thread (sequence of particular thread is not reproducible,
+    ///use counter_rng then).
     template <class Float = float>
     inline Float gen() noexcept
     {
-        using engine_t = std::conditional< (7 < sizeof(void*)), std::mt19937_64, std::mt19937>::type;
         static_assert(std::is_floating_point<Float>::value, "Floating point type expected.");
+        static std::atomic<std::uint64_t> threads{0};
+        thread_local counter_rng rng(master_seed().load(), gen_streams | threads.fetch_add(1, std::memory_order_relaxed));
 
-        //seeding pseudo random engine by real entropy
-        static engine_t pseudo_rnd(std::random_device{}());
-
-        //making distributor in range [0.1; 0.7) as NN does not like 0 and 1
-        static std::uniform_real_distribution<Float> dis(static_cast<Float>(0.1), static_cast<Float>(0.7));
-        return dis(pseudo_rnd);
+        std::uniform_real_distribution<Float> dis(static_cast<Float>(0.1), static_cast<Float>(0.7));
+        return dis(rng);
     }
 
-    template <class Float, int ...Ts>
-    inline void fill_random(Eigen::Matrix<Float, Ts...>& src) noexcept
+    ///fills any matrix with data()/size() by gen()
+    template <class Matrix>
+    inline void fill_random(Matrix& src) noexcept
     {
-        const size_t sz = src.cols() * src.rows();
+        using Float = std::decay_t<decltype(*src.data())>;
+        const size_t sz = src.size();
         for (size_t i = 0; i < sz; ++i)
             *(src.data() + i) = gen<Float>();
-
     }
 
-    template <class Float, class T, class ...Ts>
+    template <class T, class ...Ts>
     void fill_random_1by1(T& left, Ts& ...others)
     {
-        fill_random<Float>(left);
+        fill_random(left);
         if constexpr (sizeof...(Ts) > 0)
         {
-            fill_random_1by1<Float>(others...);
+            fill_random_1by1(others...);
         }
     }
 
-    template <class Float, class ...Ts>
+    template <class ...Ts>
     inline void fill_random(std::tuple<Ts...> &src)
     {
         std::apply([](auto& a, auto& ... b)
         {
-            fill_random_1by1<Float>(a, b...);
+            fill_random_1by1(a, b...);
         }, src);
     }
 }
+
+namespace nntest
+{
+    //compares parallel fill_normal with batches generated 1 by 1 on calling thread
+    /*
+    Expecting result: 0
+    */
+    inline size_t fill_normal_mismatches()
+    {
+        constexpr size_t count = 1000003;
+        std::vector<float> par_fill(count);
+        rnd_nn::fill_normal(par_fill.data(), count, 0.f, 1.f, 42, 7);
+
+        size_t res = 0;
+        float tmp[rnd_nn::details::normal_batch];
+        for (size_t b = 0; b * rnd_nn::details::normal_batch < count; ++b)
+        {
+            rnd_nn::details::normal_batch_at(42, 7, b, 0.f, 1.f, tmp);
+            for (size_t i = 0; i < rnd_nn::details::normal_batch && b * rnd_nn::details::normal_batch + i < count; ++i)
+                res += tmp[i] != par_fill[b * rnd_nn::details::normal_batch + i];
+        }
+        return res;
+    }
+
+    //bijection gives every value of [0, count) exactly once for small and big counts
+    /*
+    Expecting result: 0
+    */
+    inline size_t bijection_errors()
+    {
+        size_t res = 0;
+        for (const size_t count : {size_t{1}, size_t{2}, size_t{3}, size_t{7}, size_t{100}, size_t{1000}, size_t{60000}, size_t{65537}})
+        {
+            const rnd_nn::bijection order(count, 42, count);
+            std::vector<char> seen(count, 0);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const size_t v = order(i);
+                res += v >= count || seen[v];
+                if (v < count)
+                    seen[v] = 1;
+            }
+        }
+        return res;
+    }
+
+    //values of gen() on new thread which repeat values of streams 0..15 of the same master seed
+    //(streams of weights init, fill_normal(), permutation() and others)
+    /*
+    Expecting result: 0
+    */
+    inline size_t gen_stream_repeats()
+    {
+        constexpr size_t count = 64;
+        std::vector<float> own(count);
+        std::thread([&own]()
+        {
+            for (auto& v : own)
+                v = rnd_nn::gen<float>();
+        }).join();
+
+        size_t res = 0;
+        for (std::uint64_t stream = 0; stream < 16; ++stream)
+        {
+            rnd_nn::counter_rng rng(rnd_nn::master_seed().load(), stream);
+            std::uniform_real_distribution<float> dis(0.1f, 0.7f);
+            for (size_t i = 0; i < count; ++i)
+                res += dis(rng) == own[i];
+        }
+        return res;
+    }
+}
@@ -1,21 +1,43 @@
 #pragma once
 
 #include <tuple>
-#include <random>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
 #include <cmath>
-#include <execution>
 #include <functional>
 
 #include "types_helpers.h"
 #include "cm_ctors.h"
 #include "matrix2d.h"
+#include "parallel.h"
+#include "nn_config.h"
+#include "nn_stats.h"
+#include "rnd_nn.h"
+#include "heap_counter.h"
 
 ///should be at least 2 numbers passed - input and output layer,
-///more numbers between are sizes of hidden layers
-template <class Float, size_t ...Args>
+///more numbers between are sizes of hidden layers.
+///FloatOrConfig is floating type or nn::config<Float, Options...> (see nn_config.h)
+template <class FloatOrConfig, size_t ...Args>
 class SimpleLayeredNN
 {
 public:
+    using Float = typename nn::config_traits<FloatOrConfig>::float_t;
+
+    ///accuracy of transcendental functions used by activations
+    static constexpr vmath::accuracy accuracy = nn::config_traits<FloatOrConfig>::accuracy;
+
+    using activations_t = typename nn::config_traits<FloatOrConfig>::activations_t;
+
+    ///type single sample passes read weights from (see nn::storage), Float if not set
+    using storage_t = typename nn::config_traits<FloatOrConfig>::storage_t;
+    static constexpr bool mixed_precision = !std::is_same<storage_t, Float>::value;
+
+    ///train/query are measured (see nn::profiling), stats() returns zeros otherwise
+    static constexpr bool profiling = nn::config_traits<FloatOrConfig>::profiling;
+
     static constexpr size_t layers_count = sizeof...(Args);
 
     template<size_t R, size_t C>
@@ -23,9 +45,50 @@ public:
 
     constexpr static size_t inputs_count  = thelpers::first_v<Args...>();
     constexpr static size_t outputs_count = thelpers::last_v<Args...>();
+
+    static constexpr std::array<size_t, layers_count> layer_sizes{Args...};
+
+    ///preallocated buffers for 1 training step of this topology, N is amount of samples trained at once.
+    ///Create once and pass into train()/train_batch(), then training step does not allocate.
+    template <size_t N = 1>
+    class workspace
+    {
+    private:
+        friend class SimpleLayeredNN;
+
+        //matrix per layer (except input one), each has N columns
+        template <size_t ...I>
+        static auto make_layers(std::index_sequence<I...>) -> std::tuple<Matrix2D<Float, layer_sizes[I + 1], N>...>;
+
+        using layers_t = decltype(make_layers(std::make_index_sequence<layers_count - 1>()));
+
+        layers_t outputs;
+        //error of each layer, during back propagation it is multiplied by derivative in place
+        layers_t errors;
+
+        //used when batch is stacked from separated samples
+        Matrix2D<Float, inputs_count, N>  batch_inputs;
+        Matrix2D<Float, outputs_count, N> batch_targets;
+    public:
+        workspace()  = default;
+        ~workspace() = default;
+        DEFAULT_COPYMOVE(workspace);
+
+        ///outputs of the network for the last trained batch (before its update), 1 column per sample
+        const Matrix2D<Float, outputs_count, N>& output() const noexcept
+        {
+            return std::get<layers_count - 2>(outputs);
+        }
+    };
 private:
     static_assert(std::is_floating_point<Float>::value, "Expecting floating point type only.");
     static_assert(layers_count > 1, "Expecting at least 2 additional template parameters.");
+    static_assert(activations_t::count == 1 || activations_t::count == layers_count - 1,
+                  "Expecting single activation or activation per each layer except input one.");
+
+    //activation policy of the layer Index (0 is the first layer after inputs)
+    template <size_t Index>
+    using activation_t = typename activations_t::template layer<Index>;
 
     //builds tuple of weight matrixes recursively out of template sizes
     template <size_t index, class Tuple>
@@ -54,48 +117,23 @@ private:
     }
 
     //fills single weight matrix with random values, gaussian distribution where
-    //stddev of it is 1 / root(incoming_connections)
+    //stddev of it is 1 / root(incoming_connections), values depend on (seed, stream) only
     template <size_t R, size_t C>
-    static void fill_matrix_random(WeightsMatrixT<R, C>& src) noexcept
+    static void fill_matrix_random(WeightsMatrixT<R, C>& src, const std::uint64_t seed, const std::uint64_t stream)
     {
-        using engine_t = std::conditional< (7 < sizeof(void*)), std::mt19937_64, std::mt19937>::type;
-
-        //seeding pseudo random engine by real entropy
-        engine_t pseudo_rnd(std::random_device{}());
-
-        //making distributor
         const Float sdev = pow(cast(src.rows()), cast(-0.5f));
-        std::normal_distribution<Float> dis(cast(0.), sdev);
-
-        const auto rnd =[&dis, &pseudo_rnd]()
-        {
-            Float v, a;
-            do
-            {
-                v = dis(pseudo_rnd);
-                a = std::fabs(v);
-            }
-            while(a < 0.001 && a > 0.999);
-            return v;
-        };
-
-        for (auto& v : src)
-            v = rnd();
+        rnd_nn::fill_normal(src.data(), src.size(), cast(0.), sdev, seed, stream);
     }
 
-    //recursively applies random for each matrix in tuple
-    template <class T, class ...Ts>
-    static void fill_random_1by1(T& left, Ts& ...others) noexcept
+    //applies random for each matrix in tuple, layer index is the stream
+    template <class Tuple, size_t ...I>
+    static void fill_random_all(Tuple& all, const std::uint64_t seed, std::index_sequence<I...>)
     {
-        fill_matrix_random(left);
-        if constexpr (sizeof...(Ts) > 0)
-        {
-            fill_random_1by1(others...);
-        }
+        (fill_matrix_random(std::get<I>(all), seed, I), ...);
     }
 
 //----------------------------------------------------------------------------------
-#define NO_COPY_PASTE(NAME) if constexpr (szo < 1) \
+#define NO_COPY_PASTE(NAME, NEXT) if constexpr (szo < 1) \
 { \
     if constexpr (!KeepAll) \
         return o; \
@@ -105,111 +143,300 @@ private:
 if constexpr (szo > 0) \
 { \
     if constexpr (KeepAll)\
-        return std::tuple_cat(std::make_tuple(o),  forward<KeepAll>(o, others...));\
+        return std::tuple_cat(std::make_tuple(o),  NAME<KeepAll, NEXT>(o, others...));\
     if constexpr (!KeepAll)\
-        return NAME<KeepAll>(o, others...);}
+        return NAME<KeepAll, NEXT>(o, others...);}
 //----------------------------------------------------------------------------------
 
     //if KeepAll = true then it will return all calculations as tuple
     //otherwise it will return only last one as single value
-    template <bool KeepAll, class Inps, class T, class ...Ts>
-    static decltype(auto) forward(const Inps& inps, T& left, Ts& ...others) noexcept
+    template <bool KeepAll, size_t Index, class Inps, class T, class ...Ts>
+    decltype(auto) forward(const Inps& inps, T& left, Ts& ...others) const noexcept
     {
         constexpr auto szo = sizeof...(others);
-        const auto o = activation_function(left.dot(inps));
-        NO_COPY_PASTE(forward);
+        const auto o = [&]()
+        {
+            [[maybe_unused]] const auto phase = recorder.query_forward(Index);
+            return activation_function<Index>(left.dot(inps));
+        }();
+        NO_COPY_PASTE(forward, Index + 1);
     }
 
-    template <bool KeepAll, class Inps, class T, class ...Ts>
+    //goes from the output layer to inputs: undoes activation of the layer, then its weights
+    template <bool KeepAll, size_t Index, class Inps, class T, class ...Ts>
     static decltype(auto) backward(const Inps& inps, T& left, Ts& ...others) noexcept
     {
         constexpr auto szo = sizeof...(others);
-        const auto o = reverse_activation_function(left.dot(inps));
-        NO_COPY_PASTE(backward);
+        const auto o = left.tdot(reverse_activation_function<Index>(inps));
+        NO_COPY_PASTE(backward, Index - 1);
     }
 #undef NO_COPY_PASTE
 
-    template <class Mat>
-    static Mat activation_function(const Mat& src) noexcept
+    //runs op(from, to) over count values, big arrays are split between threads
+    template <class Op>
+    static void for_values(const size_t count, Op&& op) noexcept
     {
-        constexpr static Float one  = cast(1.f);
-        Mat res;
-        //FIXME: doing parallel here shows data-race by thread sanitizer, not sure why yet...
-        std::transform(std::execution::par_unseq, src.begin(), src.end(), res.begin(), [](const Float& x)
+        par::for_chunks(count, PAR_GRAIN, op);
+    }
+
+    //activation of the layer Index over count values
+    template <size_t Index>
+    static void activation(const Float* src, Float* dst, const size_t count) noexcept
+    {
+        for_values(count, [src, dst](const size_t from, const size_t to)
         {
-            return one / (one + cast(exp(-x)));
+            activation_t<Index>::template forward<accuracy>(src + from, dst + from, to - from);
         });
+    }
+
+    template <size_t Index, class Mat>
+    static Mat activation_function(const Mat& src) noexcept
+    {
+        Mat res(src);
+        activate_inplace<Index>(res);
         return res;
     }
 
-    template <class Mat>
+    template <size_t Index, class Mat>
     static Mat reverse_activation_function(const Mat& src) noexcept
     {
-        constexpr static Float one  = cast(1.f);
-        Mat res;
-        std::transform(std::execution::par_unseq, src.begin(), src.end(), res.begin(), [](const Float& y)->Float
+        Mat res(src);
+        for_values(res.size(), [&res](const size_t from, const size_t to)
         {
-            return log1p(static_cast<Float>(y / (one - y)));
+            activation_t<Index>::template inverse<accuracy>(res.data() + from, res.data() + from, to - from);
         });
         return res;
     }
 
-    template <size_t Index, class IniErrs, class ...Tw>
-    static auto build_errors(IniErrs&& errs, const std::tuple<Tw...>& w)
+    template <bool KeepAllOuts, class Inps>
+    auto forward_all(const Inps& inputs) const noexcept
+    {
+        return std::apply([&](auto& a, auto& ... b)
+        {
+            return forward<KeepAllOuts, 0>(inputs, a, b...);
+        }, weights);
+    }
+
+    template <size_t Index, class Mat>
+    static void activate_inplace(Mat& m) noexcept
     {
-        constexpr auto max_size = sizeof...(Tw) - 1;
-        constexpr bool keep_recurse = Index < max_size;
+        activation<Index>(m.data(), m.data(), m.size());
+    }
 
-        if constexpr (keep_recurse)
+    template <size_t Index, size_t N>
+    static const auto& layer_input(const workspace<N>& ws, const Matrix2D<Float, inputs_count, N>& inputs) noexcept
+    {
+        if constexpr (Index == 0)
+            return inputs;
+        else
+            return std::get<Index - 1>(ws.outputs);
+    }
+
+    template <size_t Index, size_t N>
+    void forward_layer(workspace<N>& ws, const Matrix2D<Float, inputs_count, N>& inputs) const
+    {
+        auto& o = std::get<Index>(ws.outputs);
+        const auto& w = std::get<Index>(weights);
+        if constexpr (mixed_precision && N == 1)
+            gemm::gemv(w.rows(), w.cols(), cast(1), storage[Index].data(), w.cols(), layer_input<Index>(ws, inputs).data(),
+                       cast(0), o.data());
+        else
+            w.dot(layer_input<Index>(ws, inputs), o);
+        activate_inplace<Index>(o);
+    }
+
+    //turns error of the layer Index into delta = error * f'(x) in place, then propagates delta
+    //into error of the layer Index - 1, uses weights before update
+    template <size_t Index, size_t N>
+    void backprop_error(workspace<N>& ws) const
+    {
+        const auto& o = std::get<Index>(ws.outputs);
+        auto& delta   = std::get<Index>(ws.errors);
+
+        //derivative is computed by policy out of stored outputs, fused with multiplication
+        for_values(delta.size(), [&o, &delta](const size_t from, const size_t to)
         {
-            auto newerr = std::make_tuple(std::get<Index>(w).transpose().dot(std::get<Index>(errs)));
-            return build_errors<Index+1>(std::tuple_cat(std::move(errs), std::move(newerr)), w);
-        }
+            activation_t<Index>::backward(o.data() + from, delta.data() + from, to - from);
+        });
 
-        if constexpr (!keep_recurse)
-            return errs;
+        //previous layer gets W^T * (e * f'), which is gradient of the loss by its outputs
+        if constexpr (Index > 0)
+        {
+            const auto& w = std::get<Index>(weights);
+            if constexpr (mixed_precision && N == 1)
+                gemm::gemv_t(w.rows(), w.cols(), cast(1), storage[Index].data(), w.cols(), delta.data(), cast(0),
+                             std::get<Index - 1>(ws.errors).data());
+            else
+                w.tdot(delta, std::get<Index - 1>(ws.errors));
+        }
     }
 
-    template <size_t Index, class Errors, class Outs, class ...Tw>
-    static void update_weights(const Float learning_rate, const Errors& err, const Outs& outs, std::tuple<Tw...>& w)
+    template <size_t Index, size_t N>
+    void update_layer(workspace<N>& ws, const Float learning_rate, const Matrix2D<Float, inputs_count, N>& inputs)
     {
-        if constexpr(Index < sizeof...(Tw))
+        //weights += learning_rate * delta * inputs^T, in place
+        auto& w = std::get<Index>(weights);
+        if constexpr (mixed_precision && N == 1)
         {
-            {
-                //separated block, so extra data are deallocated prior recursive call
-                const auto& o  = std::get<Index>(outs);
-                const auto no  = std::get<Index + 1>(outs).transpose();
-                const auto m1  = std::get<Index>(err) * o * (cast(1) - o);
-                std::get<Index>(w) += m1.dot(no) * learning_rate;
-            }
-            update_weights<Index + 1>(learning_rate, err, outs, w);
+            //master copy and its 16 bit copy are updated in the same pass
+            gemm::ger(w.rows(), w.cols(), learning_rate, std::get<Index>(ws.errors).data(), layer_input<Index>(ws, inputs).data(),
+                      w.data(), w.cols(), storage[Index].data());
+        }
+        else
+        {
+            w.add_outer(learning_rate, std::get<Index>(ws.errors), layer_input<Index>(ws, inputs));
+            if constexpr (mixed_precision)
+                sync_layer_storage<Index>();
         }
     }
+
+    //rounds master weights of the layer into 16 bit copy
+    template <size_t Index>
+    void sync_layer_storage()
+    {
+        const auto& w = std::get<Index>(weights);
+        storage[Index].resize(w.size());
+        fp::convert(w.data(), storage[Index].data(), w.size());
+    }
+
+    template <size_t ...I>
+    void sync_storage(std::index_sequence<I...>)
+    {
+        (sync_layer_storage<I>(), ...);
+    }
+
+    //works for single sample (N = 1) and for batches where samples are columns of matrix,
+    //in the last case gradients of all columns are summed by add_outer() in update_layer
+    template <size_t N, size_t ...I>
+    void train_step(workspace<N>& ws, const Float learning_rate, const Matrix2D<Float, inputs_count, N>& inputs,
+                    const Matrix2D<Float, outputs_count, N>& targets, std::index_sequence<I...>)
+    {
+        constexpr size_t last = sizeof...(I) - 1;
+        [[maybe_unused]] const auto call = recorder.train(N);
+
+        ([&]()
+        {
+            [[maybe_unused]] const auto phase = recorder.forward(I);
+            forward_layer<I>(ws, inputs);
+        }(), ...);
+        std::get<last>(ws.errors) = targets - std::get<last>(ws.outputs);
+        ([&]()
+        {
+            [[maybe_unused]] const auto phase = recorder.backprop(last - I);
+            backprop_error<last - I>(ws);
+        }(), ...);
+        ([&]()
+        {
+            [[maybe_unused]] const auto phase = recorder.update(I);
+            update_layer<I>(ws, learning_rate, inputs);
+        }(), ...);
+    }
+
+    template <size_t ...I>
+    void query_storage(workspace<1>& ws, const VectorRow<Float, inputs_count>& inputs, std::index_sequence<I...>) const
+    {
+        ([&]()
+        {
+            [[maybe_unused]] const auto phase = recorder.query_forward(I);
+            forward_layer<I>(ws, inputs);
+        }(), ...);
+    }
+
+    template <size_t N>
+    void train_step(workspace<N>& ws, const Float learning_rate, const Matrix2D<Float, inputs_count, N>& inputs,
+                    const Matrix2D<Float, outputs_count, N>& targets)
+    {
+        train_step(ws, learning_rate, inputs, targets, std::make_index_sequence<layers_count - 1>());
+    }
+
+    //calls f(std::integral_constant<size_t, Index>) for each weights layer in order
+    template <class F, size_t ...I>
+    static void for_each_layer(F&& f, std::index_sequence<I...>)
+    {
+        (f(std::integral_constant<size_t, I>{}), ...);
+    }
+
+    template <class F>
+    static void for_each_layer(F&& f)
+    {
+        for_each_layer(std::forward<F>(f), std::make_index_sequence<layers_count - 1>());
+    }
 private:
     std::invoke_result_t<decltype(&make_weights)> weights{make_weights()};
+
+    //16 bit copy of each weights matrix when mixed_precision, it is empty otherwise
+    using storage_vector = AlignedVector<storage_t, prefFloatsAlign()>;
+    std::conditional_t<mixed_precision, std::array<storage_vector, layers_count - 1>, std::tuple<>> storage;
+
+    //updated by const query() too
+    mutable nn::stats_recorder<layers_count - 1, profiling> recorder;
 public:
-    SimpleLayeredNN() = default;
+    SimpleLayeredNN()
+    {
+        sync_storage();
+    }
+
     ~SimpleLayeredNN()= default;
     DEFAULT_COPYMOVE(SimpleLayeredNN);
 
-    ///set all weights randomly
-    SimpleLayeredNN& random_weights() noexcept
+    ///set all weights randomly, seeded by rnd_nn::master_seed()
+    SimpleLayeredNN& random_weights()
     {
-        std::apply([](auto& a, auto& ... b)
-        {
-            fill_random_1by1(a, b...);
-        }, weights);
+        return random_weights(rnd_nn::master_seed().load());
+    }
+
+    ///set all weights randomly, the same seed gives the same weights with any amount of threads
+    SimpleLayeredNN& random_weights(const std::uint64_t seed)
+    {
+        fill_random_all(weights, seed, std::make_index_sequence<layers_count - 1>());
+        sync_storage();
 
         return *this;
     }
 
+    ///tuple of weight matrices, 1st one connects inputs with the 1st hidden layer.
+    ///Call sync_storage() after weights were changed through it.
+    auto& layers_weights() noexcept
+    {
+        return weights;
+    }
+
+    ///counters of train/query calls since creation or reset_stats(), see nn::profiling
+    nn::stats<layers_count - 1> stats() const noexcept
+    {
+        return recorder.snapshot();
+    }
+
+    void reset_stats() noexcept
+    {
+        recorder.reset();
+    }
+
+    ///updates 16 bit copy of weights out of master weights (does nothing without nn::storage option)
+    void sync_storage()
+    {
+        if constexpr (mixed_precision)
+            sync_storage(std::make_index_sequence<layers_count - 1>());
+    }
+
+    const auto& layers_weights() const noexcept
+    {
+        return weights;
+    }
+
     template <bool KeepAllOuts = false>
     auto query(const VectorRow<Float, inputs_count>& inputs) const noexcept
     {
-        return std::apply([&](auto& a, auto& ... b)
+        [[maybe_unused]] const auto call = recorder.query(1);
+        //single sample forward is bound by weights bandwidth, 16 bit copy is read if there is one
+        if constexpr (mixed_precision && !KeepAllOuts)
         {
-            return forward<KeepAllOuts>(inputs, a, b...);
-        }, weights);
+            workspace<1> ws;
+            query_storage(ws, inputs, std::make_index_sequence<layers_count - 1>());
+            return std::get<layers_count - 2>(ws.outputs);
+        }
+        else
+            return forward_all<KeepAllOuts>(inputs);
     }
 
 
@@ -219,25 +446,107 @@ public:
         const auto rweights = thelpers::reverse_tuple_ref(weights);
         return std::apply([&outputs](auto& a, auto& ... b)
         {
-            return backward<KeepAllOuts>(outputs, a, b...);
+            return backward<KeepAllOuts, layers_count - 2>(outputs, a, b...);
         }, rweights);
     }
 
 
-    void train(const Float learning_rate, const VectorRow<Float, inputs_count>& inputs, const VectorRow<Float, outputs_count>& targets)
+    ///batched inference, each column of inputs is 1 sample, each column of result is its output
+    template <size_t N>
+    auto query_batch(const Matrix2D<Float, inputs_count, N>& inputs) const noexcept
     {
-        //outputs from each layer
-        const auto outputs = query<true>(inputs);
+        [[maybe_unused]] const auto call = recorder.query(N);
+        return forward_all<false>(inputs);
+    }
+
+    ///batched inference over contiguous block of count samples: inputs are count * inputs_count values
+    ///(sample after sample, as VectorRow stores it), outputs receive count * outputs_count values.
+    ///Samples are processed by tiles, so each weight matrix is streamed once per tile, not once per sample.
+    void query_batch(const Float* inputs, const size_t count, Float* outputs) const
+    {
+        [[maybe_unused]] const auto call = recorder.query(count);
+        constexpr size_t tile = 256;
+        constexpr size_t max_width = std::max({Args...});
+        AlignedVector<Float, prefFloatsAlign()> ping(tile * max_width);
+        AlignedVector<Float, prefFloatsAlign()> pong(tile * max_width);
+
+        for (size_t s0 = 0; s0 < count; s0 += tile)
         {
-            //tuples of references to matrices in reverse order
-            const auto routputs = std::tuple_cat(thelpers::reverse_tuple_ref(outputs), std::tie(inputs));
-            auto rweights = thelpers::reverse_tuple_ref(weights);
-            const auto errors   = build_errors<0>(std::make_tuple(targets - std::get<0>(routputs)), rweights);
+            const size_t n = std::min(tile, count - s0);
+            const Float* src = inputs + s0 * inputs_count;
 
-            update_weights<0>(learning_rate, errors, routputs, rweights);
+            for_each_layer([&](const auto index)
+            {
+                constexpr size_t layer = decltype(index)::value;
+                const auto& wm = std::get<layer>(weights);
+                constexpr bool last = layer == layers_count - 2;
+                Float* dst = last ? outputs + s0 * outputs_count : (src == ping.data() ? pong.data() : ping.data());
+
+                [[maybe_unused]] const auto phase = recorder.query_forward(layer);
+                //dst(n x R) = src(n x C) * W^T, W^T is read by swapped strides
+                const size_t R = wm.rows();
+                const size_t C = wm.cols();
+                gemm::gemm(n, R, C, cast(1), src, C, 1, wm.data(), 1, C, cast(0), dst, R);
+                activation<layer>(dst, dst, n * R);
+                src = dst;
+            });
         }
     }
 
+    void train(const Float learning_rate, const VectorRow<Float, inputs_count>& inputs, const VectorRow<Float, outputs_count>& targets)
+    {
+        workspace<1> ws;
+        train(ws, learning_rate, inputs, targets);
+    }
+
+    ///same as above, but all intermediate data are kept in ws, so no allocations are done
+    void train(workspace<1>& ws, const Float learning_rate, const VectorRow<Float, inputs_count>& inputs,
+               const VectorRow<Float, outputs_count>& targets)
+    {
+        train_step(ws, learning_rate, inputs, targets);
+    }
+
+    ///mini-batch training, each column is 1 sample, weights are updated once per batch
+    ///by gradient averaged over N samples
+    template <size_t N>
+    void train_batch(const Float learning_rate, const Matrix2D<Float, inputs_count, N>& inputs,
+                     const Matrix2D<Float, outputs_count, N>& targets)
+    {
+        workspace<N> ws;
+        train_batch(ws, learning_rate, inputs, targets);
+    }
+
+    template <size_t N>
+    void train_batch(workspace<N>& ws, const Float learning_rate, const Matrix2D<Float, inputs_count, N>& inputs,
+                     const Matrix2D<Float, outputs_count, N>& targets)
+    {
+        static_assert(N > 0, "Empty batch.");
+        train_step(ws, learning_rate / cast(N), inputs, targets);
+    }
+
+    ///stacks N samples starting from first into batch and trains on it,
+    ///sample is pair-like: first is inputs vector, second is targets vector (see mnist_loader::train_value)
+    template <size_t N, class Iter>
+    void train_batch(const Float learning_rate, Iter first)
+    {
+        workspace<N> ws;
+        train_batch(ws, learning_rate, first);
+    }
+
+    template <size_t N, class Iter>
+    void train_batch(workspace<N>& ws, const Float learning_rate, Iter first)
+    {
+        for (size_t c = 0; c < N; ++c, ++first)
+        {
+            const auto& sample = *first;
+            for (size_t r = 0; r < inputs_count; ++r)
+                ws.batch_inputs.at(r, c) = sample.first.at(r, 0);
+            for (size_t r = 0; r < outputs_count; ++r)
+                ws.batch_targets.at(r, c) = sample.second.at(r, 0);
+        }
+        train_batch(ws, learning_rate, ws.batch_inputs, ws.batch_targets);
+    }
+
     ///alias for static_cast<Float> template parameter
     template<class Any>
     static constexpr Float cast(const Any v) noexcept
@@ -246,3 +555,120 @@ public:
     }
 };
 
+
+namespace nntest
+{
+    //max difference between gradient of loss 0.5 * sum((targets - outputs)^2) by each weight, as 1 train() step
+    //with learning rate 1 applies it, and central finite difference of the same loss, relative to max gradient
+    template <class Net>
+    inline double gradient_error()
+    {
+        using Float = typename Net::Float;
+        Net nn;
+        nn.random_weights(7);
+        VectorRow<Float, Net::inputs_count> inputs;
+        VectorRow<Float, Net::outputs_count> targets;
+        rnd_nn::fill_uniform(inputs.data(), inputs.size(), Float(0.01), Float(0.99), 7, 1);
+        rnd_nn::fill_uniform(targets.data(), targets.size(), Float(0.01), Float(0.99), 7, 2);
+
+        const auto loss = [&]()
+        {
+            const auto o = nn.query(inputs);
+            double sum = 0;
+            for (size_t i = 0; i < o.size(); ++i)
+                sum += 0.5 * static_cast<double>(targets.data()[i] - o.data()[i]) * static_cast<double>(targets.data()[i] - o.data()[i]);
+            return sum;
+        };
+
+        //train() adds -learning_rate * gradient to weights
+        Net trained = nn;
+        trained.train(Float(1), inputs, targets);
+
+        constexpr double h = 1e-6;
+        double max_diff = 0;
+        double max_grad = 0;
+        const auto check_layer = [&](auto& w, const auto& w_trained)
+        {
+            for (size_t i = 0; i < w.size(); ++i)
+            {
+                const Float saved = w.data()[i];
+                w.data()[i] = saved + static_cast<Float>(h);
+                const double plus = loss();
+                w.data()[i] = saved - static_cast<Float>(h);
+                const double minus = loss();
+                w.data()[i] = saved;
+
+                const double numeric  = (plus - minus) / (2 * h);
+                const double analytic = static_cast<double>(saved) - static_cast<double>(w_trained.data()[i]);
+                max_diff = std::max(max_diff, std::abs(numeric - analytic));
+                max_grad = std::max(max_grad, std::abs(numeric));
+            }
+        };
+        std::apply([&](auto& ...w)
+        {
+            std::apply([&](const auto& ...wt)
+            {
+                (check_layer(w, wt), ...);
+            }, trained.layers_weights());
+        }, nn.layers_weights());
+        return max_grad > 0 ? max_diff / max_grad : max_diff;
+    }
+
+    //back propagation against finite differences in double for each activation policy
+    /*
+    Expecting result: less than 1e-6
+    */
+    inline double gradient_check()
+    {
+        return std::max({
+            gradient_error<SimpleLayeredNN<nn::config<double, nn::activations<act::sigmoid>>, 5, 7, 6, 3>>(),
+            gradient_error<SimpleLayeredNN<nn::config<double, nn::activations<act::tanh>>, 5, 7, 6, 3>>(),
+            gradient_error<SimpleLayeredNN<nn::config<double, nn::activations<act::leaky_relu<std::ratio<1, 10>>,
+                                                                                act::tanh, act::sigmoid>>, 5, 7, 6, 3>>(),
+        });
+    }
+
+    //returns amount of heap allocations (any, counted by replaced global operator new, see heap_counter.h)
+    //done by 50 training steps (5 rounds of 10) which reuse the same workspace, N = 1 trains by train(),
+    //otherwise by train_batch<N>().
+    //Program must define HEAP_COUNTER_IMPLEMENT in 1 translation unit, otherwise -1 is returned.
+    /*
+    Expecting result: 0
+    */
+    template <size_t N = 1>
+    inline size_t workspace_train_allocations()
+    {
+        using nn_t = SimpleLayeredNN<float, 784, 200, 200, 10>;
+        static nn_t nn;
+        nn.random_weights();
+
+        typename nn_t::template workspace<N> ws;
+        const Matrix2D<float, nn_t::inputs_count, N> inputs;
+        const Matrix2D<float, nn_t::outputs_count, N> targets;
+        const auto step = [&]()
+        {
+            if constexpr (N == 1)
+                nn.train(ws, 0.1f, inputs, targets);
+            else
+                nn.train_batch(ws, 0.1f, inputs, targets);
+        };
+
+        //threads of parallel backend and their packing buffers of gemm are created before counting,
+        //1st step allocates packing buffer of calling thread
+        par::each_thread(gemm::reserve_buffers<float>);
+        step();
+        if (!HeapCounter::installed())
+            return static_cast<size_t>(-1);
+
+        //every round must be allocation free: per step allocation which happens sometimes shows in the sum
+        size_t total = 0;
+        for (int round = 0; round < 5; ++round)
+        {
+            const auto before = HeapCounter::allocations.load();
+            for (int i = 0; i < 10; ++i)
+                step();
+            total += HeapCounter::allocations.load() - before;
+        }
+        return total;
+    }
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include "mnist_binary.h"
+
+//converts MNIST csv (label,pixel0,...,pixel783 per line) into packed binary dataset,
+//which is loaded by mnist_bin::packed_dataset without parsing
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.csv> <output.bin>" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        mnist_stream src(argv[1]);
+        mnist_bin::packed_writer dst(argv[2]);
+
+        mnist_stream::train_value sample;
+        while (src.next(sample))
+            dst.write(sample);
+        dst.close();
+
+        std::cout << "Written " << dst.count() << " samples into " << argv[2] << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    return 0;
+}